@@ -0,0 +1,500 @@
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#ifndef _WIN32
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+#ifdef __linux__
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#endif
+#include "common.hh"
+#include "async_reader.hh"
+
+
+
+namespace redump_info
+{
+
+std::unique_ptr<AsyncReader> AsyncReader::Open(const std::filesystem::path &file_path, Engine engine, Cache cache, uint32_t queue_depth, uint32_t block_size)
+{
+    std::unique_ptr<AsyncReader> reader;
+
+    queue_depth = std::max(queue_depth, 1u);
+    block_size = std::max(block_size, 1u);
+    if(cache == Cache::DIRECT)
+        block_size = (block_size + DIRECT_ALIGNMENT - 1) / DIRECT_ALIGNMENT * DIRECT_ALIGNMENT;
+
+#ifdef __linux__
+    if(engine == Engine::AUTO || engine == Engine::URING)
+    {
+        try
+        {
+            reader = std::make_unique<UringReader>(file_path, cache, queue_depth, block_size);
+        }
+        catch(const std::exception &)
+        {
+            // io_uring disabled by kernel configuration or seccomp policy
+            if(engine == Engine::URING)
+                throw;
+        }
+    }
+#else
+    if(engine == Engine::URING)
+        throw_line("io_uring is not supported on this platform");
+#endif
+
+    if(!reader)
+        reader = std::make_unique<ThreadReader>(file_path, cache, queue_depth, block_size);
+
+    return reader;
+}
+
+
+AsyncReader::AsyncReader(const std::filesystem::path &file_path, Cache cache, uint32_t queue_depth, uint32_t block_size)
+    : _queueDepth(queue_depth)
+    , _blockSize(block_size)
+    , _cache(cache)
+    , _fileSize(std::filesystem::file_size(file_path))
+{
+#ifdef _WIN32
+    // not implemented, regular reads
+    _cache = Cache::KEEP;
+#endif
+}
+
+
+uint32_t AsyncReader::QueueDepth() const
+{
+    return _queueDepth;
+}
+
+
+uint32_t AsyncReader::BlockSize() const
+{
+    return _blockSize;
+}
+
+
+uint32_t AsyncReader::IssueSize(uint32_t size) const
+{
+    return _cache == Cache::DIRECT ? (size + DIRECT_ALIGNMENT - 1) / DIRECT_ALIGNMENT * DIRECT_ALIGNMENT : size;
+}
+
+
+uint32_t AsyncReader::RequiredSize(uint64_t offset, uint32_t size) const
+{
+    return offset < _fileSize ? (uint32_t)std::min<uint64_t>(size, _fileSize - offset) : 0;
+}
+
+
+#ifndef _WIN32
+int AsyncReader::OpenFile(const std::filesystem::path &file_path)
+{
+    int fd = -1;
+
+#ifdef O_DIRECT
+    if(_cache == Cache::DIRECT)
+    {
+        fd = open(file_path.c_str(), O_RDONLY | O_DIRECT);
+        if(fd == -1)
+            _cache = Cache::DROP;
+    }
+#else
+    if(_cache == Cache::DIRECT)
+        _cache = Cache::DROP;
+#endif
+
+    if(fd == -1)
+        fd = open(file_path.c_str(), O_RDONLY);
+    if(fd == -1)
+        throw_line("unable to open file (" + file_path.generic_string() + ")");
+
+#ifdef POSIX_FADV_SEQUENTIAL
+    if(_cache == Cache::DROP)
+        posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+#endif
+
+    return fd;
+}
+
+
+void AsyncReader::ReadDone(int fd, uint64_t offset, uint32_t size) const
+{
+#ifdef POSIX_FADV_DONTNEED
+    // data is in our buffer already, cached copy won't be needed
+    if(_cache == Cache::DROP)
+        posix_fadvise(fd, offset, size, POSIX_FADV_DONTNEED);
+#endif
+}
+
+
+void AsyncReader::CloseFile(int fd) const
+{
+#ifdef POSIX_FADV_DONTNEED
+    // recently read pages might have been still locked while dropping, repeat for the whole file
+    if(_cache == Cache::DROP)
+        posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+#endif
+
+    close(fd);
+}
+#endif
+
+
+ThreadReader::ThreadReader(const std::filesystem::path &file_path, Cache cache, uint32_t queue_depth, uint32_t block_size)
+    : AsyncReader(file_path, cache, queue_depth, block_size)
+#ifdef _WIN32
+    , _ifs(file_path, std::ifstream::binary)
+#endif
+    , _stop(false)
+{
+#ifdef _WIN32
+    if(_ifs.fail())
+        throw_line("unable to open file (" + file_path.generic_string() + ")");
+#else
+    _fd = OpenFile(file_path);
+#endif
+
+    _thread = std::thread(&ThreadReader::ReadLoop, this);
+}
+
+
+ThreadReader::~ThreadReader()
+{
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _stop = true;
+    }
+    _requestAvailable.notify_one();
+    _thread.join();
+
+#ifndef _WIN32
+    CloseFile(_fd);
+#endif
+}
+
+
+void ThreadReader::Submit(void *buffer, uint64_t offset, uint32_t size, uint64_t tag)
+{
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _requests.push_back(Request{buffer, offset, size, tag});
+    }
+    _requestAvailable.notify_one();
+}
+
+
+uint64_t ThreadReader::Complete()
+{
+    std::unique_lock<std::mutex> lock(_mutex);
+    _requestDone.wait(lock, [this]{ return !_completed.empty() || _exception; });
+
+    if(_exception)
+        std::rethrow_exception(_exception);
+
+    uint64_t tag = _completed.front();
+    _completed.pop_front();
+
+    return tag;
+}
+
+
+void ThreadReader::ReadLoop()
+{
+    for(;;)
+    {
+        Request r;
+        {
+            std::unique_lock<std::mutex> lock(_mutex);
+            _requestAvailable.wait(lock, [this]{ return _stop || !_requests.empty(); });
+            if(_stop)
+                break;
+
+            r = _requests.front();
+            _requests.pop_front();
+        }
+
+        try
+        {
+            ReadRequest(r);
+
+            std::lock_guard<std::mutex> lock(_mutex);
+            _completed.push_back(r.tag);
+        }
+        catch(...)
+        {
+            // drop the rest, caller is done once it gets the exception
+            std::lock_guard<std::mutex> lock(_mutex);
+            _exception = std::current_exception();
+            _requests.clear();
+        }
+        _requestDone.notify_one();
+    }
+}
+
+
+void ThreadReader::ReadRequest(const Request &r)
+{
+#ifdef _WIN32
+    _ifs.seekg(r.offset);
+    _ifs.read((char *)r.buffer, r.size);
+    if(_ifs.fail())
+        throw_line(std::string("read failure (") + std::strerror(errno) + ")");
+#else
+    uint32_t size = IssueSize(r.size);
+    uint32_t required = RequiredSize(r.offset, r.size);
+    if(required < r.size)
+        throw_line("read failure (unexpected end of file)");
+
+    for(uint32_t done = 0; done < required; )
+    {
+        ssize_t bytes = pread(_fd, (uint8_t *)r.buffer + done, size - done, r.offset + done);
+        if(bytes < 0)
+        {
+            if(errno == EINTR)
+                continue;
+            throw_line(std::string("read failure (") + std::strerror(errno) + ")");
+        }
+        else if(!bytes)
+            throw_line("read failure (unexpected end of file)");
+
+        done += (uint32_t)bytes;
+    }
+
+    ReadDone(_fd, r.offset, r.size);
+#endif
+}
+
+
+#ifdef __linux__
+static int io_uring_setup(uint32_t entries, io_uring_params *p)
+{
+    return (int)syscall(__NR_io_uring_setup, entries, p);
+}
+
+
+static int io_uring_enter(int fd, uint32_t to_submit, uint32_t min_complete, uint32_t flags)
+{
+    return (int)syscall(__NR_io_uring_enter, fd, to_submit, min_complete, flags, nullptr, 0);
+}
+
+
+UringReader::UringReader(const std::filesystem::path &file_path, Cache cache, uint32_t queue_depth, uint32_t block_size)
+    : AsyncReader(file_path, cache, queue_depth, block_size)
+    , _fd(-1)
+    , _ringFd(-1)
+    , _sqRing(MAP_FAILED)
+    , _sqRingSize(0)
+    , _cqRing(MAP_FAILED)
+    , _cqRingSize(0)
+    , _sqes(MAP_FAILED)
+    , _sqesSize(0)
+    , _requests(queue_depth)
+    , _toSubmit(0)
+{
+    for(uint32_t i = queue_depth; i; --i)
+        _freeRequests.push_back(i - 1);
+
+    try
+    {
+        _fd = OpenFile(file_path);
+
+        io_uring_params p;
+        memset(&p, 0, sizeof(p));
+        _ringFd = io_uring_setup(queue_depth, &p);
+        if(_ringFd < 0)
+            throw_line(std::string("io_uring setup failure (") + std::strerror(errno) + ")");
+
+        _sqRingSize = p.sq_off.array + p.sq_entries * sizeof(uint32_t);
+        _cqRingSize = p.cq_off.cqes + p.cq_entries * sizeof(io_uring_cqe);
+
+        // both rings share one mapping on newer kernels
+        if(p.features & IORING_FEAT_SINGLE_MMAP)
+            _sqRingSize = _cqRingSize = std::max(_sqRingSize, _cqRingSize);
+
+        _sqRing = mmap(nullptr, _sqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, _ringFd, IORING_OFF_SQ_RING);
+        if(_sqRing == MAP_FAILED)
+            throw_line("io_uring mapping failure");
+
+        if(p.features & IORING_FEAT_SINGLE_MMAP)
+            _cqRing = _sqRing;
+        else
+        {
+            _cqRing = mmap(nullptr, _cqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, _ringFd, IORING_OFF_CQ_RING);
+            if(_cqRing == MAP_FAILED)
+                throw_line("io_uring mapping failure");
+        }
+
+        _sqesSize = p.sq_entries * sizeof(io_uring_sqe);
+        _sqes = mmap(nullptr, _sqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, _ringFd, IORING_OFF_SQES);
+        if(_sqes == MAP_FAILED)
+            throw_line("io_uring mapping failure");
+
+        _sqHead = (uint32_t *)((uint8_t *)_sqRing + p.sq_off.head);
+        _sqTail = (uint32_t *)((uint8_t *)_sqRing + p.sq_off.tail);
+        _sqMask = *(uint32_t *)((uint8_t *)_sqRing + p.sq_off.ring_mask);
+        _sqArray = (uint32_t *)((uint8_t *)_sqRing + p.sq_off.array);
+        _cqHead = (uint32_t *)((uint8_t *)_cqRing + p.cq_off.head);
+        _cqTail = (uint32_t *)((uint8_t *)_cqRing + p.cq_off.tail);
+        _cqMask = *(uint32_t *)((uint8_t *)_cqRing + p.cq_off.ring_mask);
+        _cqes = (uint8_t *)_cqRing + p.cq_off.cqes;
+    }
+    catch(...)
+    {
+        Close();
+        throw;
+    }
+}
+
+
+UringReader::~UringReader()
+{
+    // kernel might still write to buffers of requests in flight, wait for them
+    while(_freeRequests.size() < _requests.size())
+    {
+        auto free_requests = _freeRequests.size();
+        try
+        {
+            Complete();
+        }
+        catch(const std::exception &)
+        {
+            // ring itself failed, nothing else can be done
+            if(_freeRequests.size() == free_requests)
+                break;
+        }
+    }
+
+    Close();
+}
+
+
+void UringReader::Submit(void *buffer, uint64_t offset, uint32_t size, uint64_t tag)
+{
+    if(_freeRequests.empty())
+        throw_line("io_uring queue overflow");
+
+    uint32_t required = RequiredSize(offset, size);
+    if(required < size)
+        throw_line("read failure (unexpected end of file)");
+
+    uint32_t request_index = _freeRequests.back();
+    _freeRequests.pop_back();
+
+    uint32_t issue_size = IssueSize(size);
+    _requests[request_index] = Request{buffer, offset, issue_size, required, tag, {buffer, issue_size}};
+    Queue(request_index);
+}
+
+
+uint64_t UringReader::Complete()
+{
+    for(;;)
+    {
+        // hand requeued and newly queued requests to the kernel right away to keep the queue depth
+        if(_toSubmit)
+        {
+            int r = io_uring_enter(_ringFd, _toSubmit, 0, 0);
+            if(r < 0)
+            {
+                if(errno != EINTR && errno != EAGAIN && errno != EBUSY)
+                    throw_line(std::string("io_uring enter failure (") + std::strerror(errno) + ")");
+            }
+            else
+                _toSubmit -= std::min(_toSubmit, (uint32_t)r);
+        }
+
+        uint32_t head = *_cqHead;
+        if(head == __atomic_load_n(_cqTail, __ATOMIC_ACQUIRE))
+        {
+            // submit whatever is left and wait for at least one completion
+            int r = io_uring_enter(_ringFd, _toSubmit, 1, IORING_ENTER_GETEVENTS);
+            if(r < 0)
+            {
+                if(errno == EINTR)
+                    continue;
+                throw_line(std::string("io_uring enter failure (") + std::strerror(errno) + ")");
+            }
+            _toSubmit -= std::min(_toSubmit, (uint32_t)r);
+            continue;
+        }
+
+        auto &cqe = ((io_uring_cqe *)_cqes)[head & _cqMask];
+        uint32_t request_index = (uint32_t)cqe.user_data;
+        int32_t res = cqe.res;
+        __atomic_store_n(_cqHead, head + 1, __ATOMIC_RELEASE);
+
+        auto &r = _requests[request_index];
+        if(res <= 0)
+        {
+            if(res == -EINTR || res == -EAGAIN)
+            {
+                Queue(request_index);
+                continue;
+            }
+
+            _freeRequests.push_back(request_index);
+            throw_line(std::string("read failure (") + (res ? std::strerror(-res) : "unexpected end of file") + ")");
+        }
+
+        // short read, requeue remaining part, direct read of the last block is expected to be short
+        if((uint32_t)res < r.required)
+        {
+            r.buffer = (uint8_t *)r.buffer + res;
+            r.offset += res;
+            r.size -= res;
+            r.required -= res;
+            r.iov = {r.buffer, r.size};
+            Queue(request_index);
+            continue;
+        }
+
+        ReadDone(_fd, r.offset, r.required);
+
+        _freeRequests.push_back(request_index);
+        return r.tag;
+    }
+}
+
+
+void UringReader::Queue(uint32_t request_index)
+{
+    auto &r = _requests[request_index];
+
+    uint32_t tail = *_sqTail;
+    uint32_t index = tail & _sqMask;
+
+    auto &sqe = ((io_uring_sqe *)_sqes)[index];
+    memset(&sqe, 0, sizeof(sqe));
+    sqe.opcode = IORING_OP_READV;
+    sqe.fd = _fd;
+    sqe.off = r.offset;
+    sqe.addr = (uint64_t)&r.iov;
+    sqe.len = 1;
+    sqe.user_data = request_index;
+
+    _sqArray[index] = index;
+    __atomic_store_n(_sqTail, tail + 1, __ATOMIC_RELEASE);
+    ++_toSubmit;
+}
+
+
+void UringReader::Close()
+{
+    if(_sqes != MAP_FAILED)
+        munmap(_sqes, _sqesSize);
+    if(_cqRing != MAP_FAILED && _cqRing != _sqRing)
+        munmap(_cqRing, _cqRingSize);
+    if(_sqRing != MAP_FAILED)
+        munmap(_sqRing, _sqRingSize);
+    if(_ringFd != -1)
+        close(_ringFd);
+    if(_fd != -1)
+        CloseFile(_fd);
+}
+#endif
+
+}
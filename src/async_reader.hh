@@ -0,0 +1,177 @@
+#pragma once
+
+
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <exception>
+#include <filesystem>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+#ifdef __linux__
+#include <sys/uio.h>
+#endif
+
+
+
+namespace redump_info
+{
+
+// asynchronous positional file reader, multiple reads can be in flight, completion order is arbitrary
+class AsyncReader
+{
+public:
+    enum class Engine
+    {
+        AUTO,
+        URING,
+        PREAD
+    };
+
+    // page cache usage
+    enum class Cache
+    {
+        // regular buffered reads
+        KEEP,
+        // O_DIRECT, page cache is bypassed, falls back to DROP if filesystem doesn't support it
+        DIRECT,
+        // buffered sequential reads, pages are dropped from cache as soon as they are read
+        DROP
+    };
+
+    // direct I/O offset, size and buffer alignment
+    static const uint32_t DIRECT_ALIGNMENT = 4096;
+
+    // AUTO tries io_uring first and falls back to a pread thread
+    static std::unique_ptr<AsyncReader> Open(const std::filesystem::path &file_path, Engine engine, Cache cache, uint32_t queue_depth, uint32_t block_size);
+
+    virtual ~AsyncReader() = default;
+
+    // maximum number of reads in flight
+    uint32_t QueueDepth() const;
+    // preferred size of one read
+    uint32_t BlockSize() const;
+
+    // queues read, buffer has to stay valid until the request is completed,
+    // for direct I/O offset and buffer have to be aligned and buffer has to have space for size rounded up to alignment
+    virtual void Submit(void *buffer, uint64_t offset, uint32_t size, uint64_t tag) = 0;
+
+    // blocks until one of the submitted reads is fully done and returns it's tag, throws on failure
+    virtual uint64_t Complete() = 0;
+
+protected:
+    uint32_t _queueDepth;
+    uint32_t _blockSize;
+    Cache _cache;
+    uint64_t _fileSize;
+
+    AsyncReader(const std::filesystem::path &file_path, Cache cache, uint32_t queue_depth, uint32_t block_size);
+
+    // number of bytes actually requested from the OS
+    uint32_t IssueSize(uint32_t size) const;
+    // bytes needed to complete the request, direct read past the end of file is short
+    uint32_t RequiredSize(uint64_t offset, uint32_t size) const;
+
+#ifndef _WIN32
+    int OpenFile(const std::filesystem::path &file_path);
+    void ReadDone(int fd, uint64_t offset, uint32_t size) const;
+    void CloseFile(int fd) const;
+#endif
+};
+
+
+// blocking preads on a dedicated thread
+class ThreadReader : public AsyncReader
+{
+public:
+    ThreadReader(const std::filesystem::path &file_path, Cache cache, uint32_t queue_depth, uint32_t block_size);
+    ~ThreadReader() override;
+
+    void Submit(void *buffer, uint64_t offset, uint32_t size, uint64_t tag) override;
+    uint64_t Complete() override;
+
+private:
+    struct Request
+    {
+        void *buffer;
+        uint64_t offset;
+        uint32_t size;
+        uint64_t tag;
+    };
+
+#ifdef _WIN32
+    std::ifstream _ifs;
+#else
+    int _fd;
+#endif
+
+    std::mutex _mutex;
+    std::condition_variable _requestAvailable;
+    std::condition_variable _requestDone;
+    std::deque<Request> _requests;
+    std::deque<uint64_t> _completed;
+    bool _stop;
+    std::exception_ptr _exception;
+    std::thread _thread;
+
+    void ReadLoop();
+    void ReadRequest(const Request &r);
+};
+
+
+#ifdef __linux__
+// io_uring driven by raw system calls, doesn't require liburing
+class UringReader : public AsyncReader
+{
+public:
+    UringReader(const std::filesystem::path &file_path, Cache cache, uint32_t queue_depth, uint32_t block_size);
+    ~UringReader() override;
+
+    void Submit(void *buffer, uint64_t offset, uint32_t size, uint64_t tag) override;
+    uint64_t Complete() override;
+
+private:
+    struct Request
+    {
+        void *buffer;
+        uint64_t offset;
+        uint32_t size;
+        uint32_t required;
+        uint64_t tag;
+        // has to stay valid until submission is consumed by kernel
+        iovec iov;
+    };
+
+    int _fd;
+    int _ringFd;
+
+    void *_sqRing;
+    size_t _sqRingSize;
+    void *_cqRing;
+    size_t _cqRingSize;
+    void *_sqes;
+    size_t _sqesSize;
+
+    uint32_t *_sqHead;
+    uint32_t *_sqTail;
+    uint32_t _sqMask;
+    uint32_t *_sqArray;
+    uint32_t *_cqHead;
+    uint32_t *_cqTail;
+    uint32_t _cqMask;
+    void *_cqes;
+
+    std::vector<Request> _requests;
+    std::vector<uint32_t> _freeRequests;
+    uint32_t _toSubmit;
+
+    void Queue(uint32_t request_index);
+    void Close();
+};
+#endif
+
+}
@@ -19,6 +19,19 @@ void throw_file_line(const std::string &message, const char *file_str, int line)
 }
 
 
+std::tm local_time(std::time_t t)
+{
+    std::tm tm;
+#ifdef _WIN32
+    localtime_s(&tm, &t);
+#else
+    localtime_r(&t, &tm);
+#endif
+
+    return tm;
+}
+
+
 std::list<std::string> cue_extract_files(const std::filesystem::path &cue_path)
 {
     std::list<std::string> files;
@@ -3,6 +3,7 @@
 
 
 #include <cstddef>
+#include <ctime>
 #include <filesystem>
 #include <list>
 #include <stdexcept>
@@ -31,6 +32,9 @@ constexpr size_t dim(T(&)[N])
 
 void throw_file_line(const std::string &message, const char *file, int line);
 
+// thread safe std::localtime()
+std::tm local_time(std::time_t t);
+
 std::list<std::string> cue_extract_files(const std::filesystem::path &cue_path);
 
 }
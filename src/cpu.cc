@@ -0,0 +1,86 @@
+#include <cstdint>
+#include "cpu.hh"
+
+#ifdef RI_ARCH_X86
+#if defined(_MSC_VER)
+#include <intrin.h>
+#else
+#include <cpuid.h>
+#endif
+#endif
+
+
+
+namespace redump_info
+{
+
+#ifdef RI_ARCH_X86
+static void cpuid(uint32_t regs[4], uint32_t leaf, uint32_t subleaf)
+{
+#if defined(_MSC_VER)
+    __cpuidex((int *)regs, leaf, subleaf);
+#else
+    __cpuid_count(leaf, subleaf, regs[0], regs[1], regs[2], regs[3]);
+#endif
+}
+
+
+static uint64_t xgetbv()
+{
+#if defined(_MSC_VER)
+    return _xgetbv(0);
+#else
+    uint32_t eax, edx;
+    __asm__ volatile("xgetbv" : "=a"(eax), "=d"(edx) : "c"(0));
+    return (uint64_t)edx << 32 | eax;
+#endif
+}
+#endif
+
+
+static CPUFeatures detect_cpu_features()
+{
+    CPUFeatures f{};
+
+#ifdef RI_ARCH_X86
+    uint32_t regs[4];
+
+    cpuid(regs, 0, 0);
+    uint32_t max_leaf = regs[0];
+
+    if(max_leaf >= 1)
+    {
+        cpuid(regs, 1, 0);
+        f.ssse3 = regs[2] & 1 << 9;
+        f.sse41 = regs[2] & 1 << 19;
+        f.pclmul = regs[2] & 1 << 1;
+
+        // AVX state has to be enabled by OS
+        bool osxsave = regs[2] & 1 << 27;
+        uint64_t xcr0 = osxsave ? xgetbv() : 0;
+        bool avx_state = (xcr0 & 0x06) == 0x06;
+        bool avx512_state = (xcr0 & 0xE6) == 0xE6;
+
+        if(max_leaf >= 7)
+        {
+            cpuid(regs, 7, 0);
+            f.sha = regs[1] & 1 << 29;
+            f.avx512f = avx512_state && regs[1] & 1 << 16;
+            f.avx512bw = avx512_state && regs[1] & 1 << 30;
+            f.avx512vl = avx512_state && regs[1] & 1u << 31;
+            f.vpclmul = avx_state && regs[2] & 1 << 10;
+        }
+    }
+#endif
+
+    return f;
+}
+
+
+const CPUFeatures &cpu_features()
+{
+    static const CPUFeatures features(detect_cpu_features());
+    return features;
+}
+
+}
@@ -0,0 +1,36 @@
+#pragma once
+
+
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define RI_ARCH_X86
+#endif
+
+// per function instruction set selection, MSVC doesn't need it as intrinsics are always available
+#if defined(__GNUC__) || defined(__clang__)
+#define RI_TARGET(arg__) __attribute__((target(arg__)))
+#else
+#define RI_TARGET(arg__)
+#endif
+
+
+
+namespace redump_info
+{
+
+// runtime detected instruction set extensions, all false on non x86 platforms
+struct CPUFeatures
+{
+    bool ssse3;
+    bool sse41;
+    bool pclmul;
+    bool sha;
+    bool avx512f;
+    bool avx512bw;
+    bool avx512vl;
+    bool vpclmul;
+};
+
+const CPUFeatures &cpu_features();
+
+}
@@ -15,10 +15,16 @@
 // - crc32_8bytes   needs only Crc32Lookup[0..7]
 // - crc32_4x8bytes needs only Crc32Lookup[0..7]
 // - crc32_16bytes  needs all of Crc32Lookup
+// - crc32_pclmul and crc32_vpclmul use the table only for the last few bytes
 
 
 #include "Crc32.h"
 
+#ifdef CRC32_USE_PCLMUL
+  #include <immintrin.h>
+  #include "../cpu.hh"
+#endif
+
 // define endianess and some integer data types
 #if defined(_MSC_VER) || defined(__MINGW32__)
   #define __LITTLE_ENDIAN 1234
@@ -511,8 +517,8 @@ uint32_t crc32_16bytes_prefetch(const void* data, size_t length, uint32_t previo
 #endif
 
 
-/// compute CRC32 using the fastest algorithm for large datasets on modern CPUs
-uint32_t crc32_fast(const void* data, size_t length, uint32_t previousCrc32)
+/// fastest table based algorithm (depending on flags CRC32_USE_LOOKUP_...)
+static uint32_t crc32_table_fast(const void* data, size_t length, uint32_t previousCrc32)
 {
 #ifdef CRC32_USE_LOOKUP_TABLE_SLICING_BY_16
   return crc32_16bytes (data, length, previousCrc32);
@@ -528,6 +534,183 @@ uint32_t crc32_fast(const void* data, size_t length, uint32_t previousCrc32)
 }
 
 
+#ifdef CRC32_USE_PCLMUL
+// folding constants are (x^n mod P) bit-reflected and shifted left by one,
+// a 128 bit lane is folded forward by D bits with x^(D+32) (low qword) and x^(D-32) (high qword)
+// see Intel's "Fast CRC Computation for Generic Polynomials Using PCLMULQDQ Instruction"
+#define CRC32_K(n96, n160) _mm_set_epi64x(n96, n160)
+
+/// fold 128 bit accumulator over the remaining 16 byte blocks and reduce it to 32 bits
+RI_TARGET("pclmul,sse4.1")
+static uint32_t crc32_pclmul_reduce(__m128i x, const uint8_t*& current, size_t& length)
+{
+  // fold by 128 bits: x^160, x^96
+  const __m128i k128 = CRC32_K(0x0ccaa009e, 0x1751997d0);
+  for (; length >= 16; current += 16, length -= 16)
+  {
+    __m128i lo = _mm_clmulepi64_si128(x, k128, 0x00);
+    x = _mm_clmulepi64_si128(x, k128, 0x11);
+    x = _mm_xor_si128(_mm_xor_si128(x, lo), _mm_loadu_si128((const __m128i*)current));
+  }
+
+  const __m128i mask32 = _mm_set_epi32(0, 0, 0, ~0);
+
+  // 128 -> 64 bits, also appends 32 zero bits
+  x = _mm_xor_si128(_mm_srli_si128(x, 8), _mm_clmulepi64_si128(x, k128, 0x10));
+
+  // 64 -> 32 bits: x^64
+  const __m128i k64 = _mm_set_epi64x(0, 0x163cd6124);
+  x = _mm_xor_si128(_mm_srli_si128(x, 4), _mm_clmulepi64_si128(_mm_and_si128(x, mask32), k64, 0x00));
+
+  // bit-reflected Barrett reduction: P' = 0x1db710641, u' = 0x1f7011641
+  const __m128i poly = _mm_set_epi64x(0x1f7011641, 0x1db710641);
+  __m128i t = _mm_clmulepi64_si128(_mm_and_si128(x, mask32), poly, 0x10);
+  t = _mm_clmulepi64_si128(_mm_and_si128(t, mask32), poly, 0x00);
+  x = _mm_xor_si128(x, t);
+
+  return (uint32_t)_mm_extract_epi32(x, 1);
+}
+
+
+/// compute CRC32 (carry-less multiplication folding, requires PCLMULQDQ and SSE4.1)
+RI_TARGET("pclmul,sse4.1")
+uint32_t crc32_pclmul(const void* data, size_t length, uint32_t previousCrc32)
+{
+  const uint8_t* current = (const uint8_t*) data;
+
+  // not worth it for short blocks
+  if (length < 64)
+    return crc32_table_fast(data, length, previousCrc32);
+
+  uint32_t crc = ~previousCrc32; // same as previousCrc32 ^ 0xFFFFFFFF
+
+  // four independent 128 bit accumulators hide multiplication latency
+  __m128i x0 = _mm_xor_si128(_mm_loadu_si128((const __m128i*)current), _mm_cvtsi32_si128((int)crc));
+  __m128i x1 = _mm_loadu_si128((const __m128i*)(current + 16));
+  __m128i x2 = _mm_loadu_si128((const __m128i*)(current + 32));
+  __m128i x3 = _mm_loadu_si128((const __m128i*)(current + 48));
+  current += 64;
+  length  -= 64;
+
+  // fold by 512 bits: x^544, x^480
+  const __m128i k512 = CRC32_K(0x1c6e41596, 0x154442bd4);
+  for (; length >= 64; current += 64, length -= 64)
+  {
+    __m128i lo0 = _mm_clmulepi64_si128(x0, k512, 0x00);
+    __m128i lo1 = _mm_clmulepi64_si128(x1, k512, 0x00);
+    __m128i lo2 = _mm_clmulepi64_si128(x2, k512, 0x00);
+    __m128i lo3 = _mm_clmulepi64_si128(x3, k512, 0x00);
+    x0 = _mm_clmulepi64_si128(x0, k512, 0x11);
+    x1 = _mm_clmulepi64_si128(x1, k512, 0x11);
+    x2 = _mm_clmulepi64_si128(x2, k512, 0x11);
+    x3 = _mm_clmulepi64_si128(x3, k512, 0x11);
+    x0 = _mm_xor_si128(_mm_xor_si128(x0, lo0), _mm_loadu_si128((const __m128i*)current));
+    x1 = _mm_xor_si128(_mm_xor_si128(x1, lo1), _mm_loadu_si128((const __m128i*)(current + 16)));
+    x2 = _mm_xor_si128(_mm_xor_si128(x2, lo2), _mm_loadu_si128((const __m128i*)(current + 32)));
+    x3 = _mm_xor_si128(_mm_xor_si128(x3, lo3), _mm_loadu_si128((const __m128i*)(current + 48)));
+  }
+
+  // fold accumulators into one: x^160, x^96
+  const __m128i k128 = CRC32_K(0x0ccaa009e, 0x1751997d0);
+  x1 = _mm_xor_si128(x1, _mm_xor_si128(_mm_clmulepi64_si128(x0, k128, 0x00), _mm_clmulepi64_si128(x0, k128, 0x11)));
+  x2 = _mm_xor_si128(x2, _mm_xor_si128(_mm_clmulepi64_si128(x1, k128, 0x00), _mm_clmulepi64_si128(x1, k128, 0x11)));
+  x3 = _mm_xor_si128(x3, _mm_xor_si128(_mm_clmulepi64_si128(x2, k128, 0x00), _mm_clmulepi64_si128(x2, k128, 0x11)));
+
+  crc = crc32_pclmul_reduce(x3, current, length);
+
+  // remaining 0 to 15 bytes
+  return crc32_table_fast(current, length, ~crc);
+}
+
+
+/// compute CRC32 (carry-less multiplication folding, requires AVX-512 and VPCLMULQDQ)
+RI_TARGET("avx512f,avx512vl,avx512bw,vpclmulqdq,pclmul,sse4.1")
+uint32_t crc32_vpclmul(const void* data, size_t length, uint32_t previousCrc32)
+{
+  const uint8_t* current = (const uint8_t*) data;
+
+  if (length < 256)
+    return crc32_pclmul(data, length, previousCrc32);
+
+  uint32_t crc = ~previousCrc32; // same as previousCrc32 ^ 0xFFFFFFFF
+
+  // four 512 bit accumulators, each holds four 128 bit lanes
+  __m512i z0 = _mm512_xor_si512(_mm512_loadu_si512(current), _mm512_inserti32x4(_mm512_setzero_si512(), _mm_cvtsi32_si128((int)crc), 0));
+  __m512i z1 = _mm512_loadu_si512(current +  64);
+  __m512i z2 = _mm512_loadu_si512(current + 128);
+  __m512i z3 = _mm512_loadu_si512(current + 192);
+  current += 256;
+  length  -= 256;
+
+  // zero-masked broadcast and extract, GCC expands the unmasked forms with an undefined pass-through operand
+  // and warns about it (-Wmaybe-uninitialized)
+  // fold by 2048 bits: x^2080, x^2016
+  const __m512i k2048 = _mm512_maskz_broadcast_i32x4(0xFFFF, CRC32_K(0x1322d1430, 0x11542778a));
+  for (; length >= 256; current += 256, length -= 256)
+  {
+    __m512i lo0 = _mm512_clmulepi64_epi128(z0, k2048, 0x00);
+    __m512i lo1 = _mm512_clmulepi64_epi128(z1, k2048, 0x00);
+    __m512i lo2 = _mm512_clmulepi64_epi128(z2, k2048, 0x00);
+    __m512i lo3 = _mm512_clmulepi64_epi128(z3, k2048, 0x00);
+    z0 = _mm512_clmulepi64_epi128(z0, k2048, 0x11);
+    z1 = _mm512_clmulepi64_epi128(z1, k2048, 0x11);
+    z2 = _mm512_clmulepi64_epi128(z2, k2048, 0x11);
+    z3 = _mm512_clmulepi64_epi128(z3, k2048, 0x11);
+    // three-way xor
+    z0 = _mm512_ternarylogic_epi64(z0, lo0, _mm512_loadu_si512(current      ), 0x96);
+    z1 = _mm512_ternarylogic_epi64(z1, lo1, _mm512_loadu_si512(current +  64), 0x96);
+    z2 = _mm512_ternarylogic_epi64(z2, lo2, _mm512_loadu_si512(current + 128), 0x96);
+    z3 = _mm512_ternarylogic_epi64(z3, lo3, _mm512_loadu_si512(current + 192), 0x96);
+  }
+
+  // fold accumulators into one: x^544, x^480
+  const __m512i k512 = _mm512_maskz_broadcast_i32x4(0xFFFF, CRC32_K(0x1c6e41596, 0x154442bd4));
+  z1 = _mm512_ternarylogic_epi64(z1, _mm512_clmulepi64_epi128(z0, k512, 0x00), _mm512_clmulepi64_epi128(z0, k512, 0x11), 0x96);
+  z2 = _mm512_ternarylogic_epi64(z2, _mm512_clmulepi64_epi128(z1, k512, 0x00), _mm512_clmulepi64_epi128(z1, k512, 0x11), 0x96);
+  z3 = _mm512_ternarylogic_epi64(z3, _mm512_clmulepi64_epi128(z2, k512, 0x00), _mm512_clmulepi64_epi128(z2, k512, 0x11), 0x96);
+
+  // remaining 64 byte blocks
+  for (; length >= 64; current += 64, length -= 64)
+    z3 = _mm512_ternarylogic_epi64(_mm512_clmulepi64_epi128(z3, k512, 0x00), _mm512_clmulepi64_epi128(z3, k512, 0x11), _mm512_loadu_si512(current), 0x96);
+
+  // fold lanes 0-2 into lane 3 by 384, 256 and 128 bits respectively
+  const __m512i k_lanes = _mm512_set_epi64(0, 0, 0x0ccaa009e, 0x1751997d0, 0x15a546366, 0x0f1da05aa, 0x174359406, 0x03db1ecdc);
+  __m512i t = _mm512_xor_si512(_mm512_clmulepi64_epi128(z3, k_lanes, 0x00), _mm512_clmulepi64_epi128(z3, k_lanes, 0x11));
+  __m128i x = _mm_xor_si128(_mm512_maskz_extracti32x4_epi32(0xF, z3, 3), _mm512_maskz_extracti32x4_epi32(0xF, t, 0));
+  x = _mm_xor_si128(x, _mm_xor_si128(_mm512_maskz_extracti32x4_epi32(0xF, t, 1), _mm512_maskz_extracti32x4_epi32(0xF, t, 2)));
+
+  crc = crc32_pclmul_reduce(x, current, length);
+
+  // remaining 0 to 15 bytes
+  return crc32_table_fast(current, length, ~crc);
+}
+#endif
+
+
+typedef uint32_t (*Crc32Function)(const void* data, size_t length, uint32_t previousCrc32);
+
+/// pick the fastest algorithm supported by the CPU
+static Crc32Function crc32_select()
+{
+#ifdef CRC32_USE_PCLMUL
+  const redump_info::CPUFeatures& cpu = redump_info::cpu_features();
+  if (cpu.avx512f && cpu.avx512vl && cpu.avx512bw && cpu.vpclmul && cpu.pclmul && cpu.sse41)
+    return crc32_vpclmul;
+  if (cpu.pclmul && cpu.sse41)
+    return crc32_pclmul;
+#endif
+  return crc32_table_fast;
+}
+
+
+/// compute CRC32 using the fastest algorithm for large datasets on modern CPUs
+uint32_t crc32_fast(const void* data, size_t length, uint32_t previousCrc32)
+{
+  static const Crc32Function crc32_best = crc32_select();
+  return crc32_best(data, length, previousCrc32);
+}
+
+
 // //////////////////////////////////////////////////////////
 // constants
 
@@ -12,6 +12,10 @@
 #define CRC32_USE_LOOKUP_TABLE_SLICING_BY_4
 #define CRC32_USE_LOOKUP_TABLE_SLICING_BY_8
 #define CRC32_USE_LOOKUP_TABLE_SLICING_BY_16
+// carry-less multiplication folding is x86 only, crc32_fast picks it at runtime if CPU supports it
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define CRC32_USE_PCLMUL
+#endif
 // - crc32_bitwise  doesn't need it at all
 // - crc32_halfbyte has its own small lookup table
 // - crc32_1byte_tableless and crc32_1byte_tableless2 don't need it at all
@@ -20,6 +24,7 @@
 // - crc32_8bytes   needs only Crc32Lookup[0..7]
 // - crc32_4x8bytes needs only Crc32Lookup[0..7]
 // - crc32_16bytes  needs all of Crc32Lookup
+// - crc32_pclmul and crc32_vpclmul use the table only for the last few bytes
 // using the aforementioned #defines the the table is automatically fitted to your needs
 
 // uint8_t, uint32_t, int32_t
@@ -64,3 +69,10 @@ uint32_t crc32_16bytes (const void* data, size_t length, uint32_t previousCrc32
 /// compute CRC32 (Slicing-by-16 algorithm, prefetch upcoming data blocks)
 uint32_t crc32_16bytes_prefetch(const void* data, size_t length, uint32_t previousCrc32 = 0, size_t prefetchAhead = 256);
 #endif
+
+#ifdef CRC32_USE_PCLMUL
+/// compute CRC32 (carry-less multiplication folding, requires PCLMULQDQ and SSE4.1)
+uint32_t crc32_pclmul  (const void* data, size_t length, uint32_t previousCrc32 = 0);
+/// compute CRC32 (carry-less multiplication folding, requires AVX-512 and VPCLMULQDQ)
+uint32_t crc32_vpclmul (const void* data, size_t length, uint32_t previousCrc32 = 0);
+#endif
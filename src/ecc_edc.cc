@@ -20,8 +20,16 @@
  */
 
 #include <algorithm>
+#include <cstddef>
+#include <cstring>
+#include "common.hh"
+#include "cpu.hh"
 #include "ecc_edc.hh"
 
+#ifdef RI_ARCH_X86
+#include <immintrin.h>
+#endif
+
 
 
 namespace redump_info
@@ -29,16 +37,21 @@ namespace redump_info
 
 uint8_t ECC::_F_LUT[_LUT_SIZE];
 uint8_t ECC::_B_LUT[_LUT_SIZE];
-bool ECC::_initialized(false);
+std::once_flag ECC::_initialized;
+bool ECC::_simd(false);
+uint8_t ECC::_F_NIBBLE_LUT[2][16];
+uint8_t ECC::_B_NIBBLE_LUT[2][16];
+uint16_t ECC::_Q_GATHER[_Q_MINOR_COUNT][_Q_MAJOR_COUNT / 2];
 
 
 ECC::ECC()
 {
-    if(!_initialized)
-    {
-        InitLUTs();
-        _initialized = true;
-    }
+    // instances are created concurrently by verification threads
+    std::call_once(_initialized, [this]()
+                   {
+                       InitLUTs();
+                       SelfTest();
+                   });
 }
 
 
@@ -54,11 +67,7 @@ cdrom::Sector::ECC ECC::Generate(cdrom::Sector &sector, bool zero_address)
         std::fill_n((uint8_t *)&sector.header, sizeof(sector.header), 0);
     }
 
-    // Compute ECC P code
-    ComputeBlock(ecc.p_parity, (uint8_t *)&sector.header, 86, 24, 2, 86);
-
-    // Compute ECC Q code
-    ComputeBlock(ecc.q_parity, (uint8_t *)&sector.header, 52, 43, 86, 88);
+    Compute(ecc, (uint8_t *)&sector.header, _simd);
 
     // Restore the address
     if(zero_address)
@@ -72,11 +81,7 @@ cdrom::Sector::ECC ECC::Generate(const uint8_t *data)
 {
     cdrom::Sector::ECC ecc;
 
-    // Compute ECC P code
-    ComputeBlock(ecc.p_parity, data, 86, 24, 2, 86);
-
-    // Compute ECC Q code
-    ComputeBlock(ecc.q_parity, data, 52, 43, 86, 88);
+    Compute(ecc, data, _simd);
 
     return ecc;
 }
@@ -89,6 +94,70 @@ void ECC::InitLUTs()
         _F_LUT[i] = (i << 1) ^ (i & 0x80 ? 0x11D : 0);
         _B_LUT[i ^ _F_LUT[i]] = i;
     }
+
+    // both F and B are multiplications by a constant in GF(2^8), hence linear:
+    // mul(x) = mul(x & 0x0F) ^ mul(x & 0xF0)
+    for(uint32_t i = 0; i < 16; ++i)
+    {
+        _F_NIBBLE_LUT[0][i] = _F_LUT[i];
+        _F_NIBBLE_LUT[1][i] = _F_LUT[i << 4];
+        _B_NIBBLE_LUT[0][i] = _B_LUT[i];
+        _B_NIBBLE_LUT[1][i] = _B_LUT[i << 4];
+    }
+
+    // Q diagonal byte offsets, diagonals 2 * n and 2 * n + 1 are always adjacent bytes
+    // (offset is even and block size is even so the pair never wraps)
+    for(uint32_t minor = 0; minor < _Q_MINOR_COUNT; ++minor)
+        for(uint32_t n = 0; n < _Q_MAJOR_COUNT / 2; ++n)
+            _Q_GATHER[minor][n] = (n * 86 + minor * 88) % (_Q_MAJOR_COUNT * _Q_MINOR_COUNT);
+
+#ifdef RI_ARCH_X86
+    _simd = cpu_features().ssse3;
+#endif
+}
+
+
+// SIMD path has to match scalar one bit for bit
+void ECC::SelfTest()
+{
+    if(!_simd)
+        return;
+
+    uint8_t data[sizeof(cdrom::Sector)];
+    uint32_t seed = 0x87654321;
+    for(uint32_t i = 0; i < 8; ++i)
+    {
+        for(auto &d : data)
+        {
+            seed = seed * 1103515245 + 12345;
+            d = i ? seed >> 16 : 0;
+        }
+
+        cdrom::Sector::ECC ecc_scalar;
+        cdrom::Sector::ECC ecc_simd;
+        Compute(ecc_scalar, data + offsetof(cdrom::Sector, header), false);
+        Compute(ecc_simd, data + offsetof(cdrom::Sector, header), true);
+        if(memcmp(&ecc_scalar, &ecc_simd, sizeof(ecc_scalar)))
+            throw_line("ECC self-test failure");
+    }
+}
+
+
+void ECC::Compute(cdrom::Sector::ECC &ecc, const uint8_t *data, bool simd)
+{
+    if(simd)
+    {
+        ComputePBlockSIMD(ecc.p_parity, data);
+        ComputeQBlockSIMD(ecc.q_parity, data);
+    }
+    else
+    {
+        // Compute ECC P code
+        ComputeBlock(ecc.p_parity, data, _P_MAJOR_COUNT, _P_MINOR_COUNT, 2, 86);
+
+        // Compute ECC Q code
+        ComputeBlock(ecc.q_parity, data, _Q_MAJOR_COUNT, _Q_MINOR_COUNT, 86, 88);
+    }
 }
 
 
@@ -119,24 +188,140 @@ void ECC::ComputeBlock(uint8_t *parity, const uint8_t *data, uint32_t major_coun
 }
 
 
-uint32_t EDC::_LUT[_LUT_SIZE];
-bool EDC::_initialized(false);
+#ifdef RI_ARCH_X86
 
+// GF(2^8) multiplication by a constant using PSHUFB nibble tables
+RI_TARGET("ssse3")
+static inline __m128i gf_multiply(__m128i x, __m128i lut_lo, __m128i lut_hi)
+{
+    const __m128i mask = _mm_set1_epi8(0x0F);
+    return _mm_xor_si128(_mm_shuffle_epi8(lut_lo, _mm_and_si128(x, mask)), _mm_shuffle_epi8(lut_hi, _mm_and_si128(_mm_srli_epi16(x, 4), mask)));
+}
 
-EDC::EDC()
+
+// P columns are contiguous in memory, 16 columns are computed at once,
+// last vector overlaps the previous one as 86 is not a multiple of 16
+RI_TARGET("ssse3")
+void ECC::ComputePBlockSIMD(uint8_t *parity, const uint8_t *data)
 {
-    if(!_initialized)
+    const __m128i f_lo = _mm_loadu_si128((const __m128i *)_F_NIBBLE_LUT[0]);
+    const __m128i f_hi = _mm_loadu_si128((const __m128i *)_F_NIBBLE_LUT[1]);
+    const __m128i b_lo = _mm_loadu_si128((const __m128i *)_B_NIBBLE_LUT[0]);
+    const __m128i b_hi = _mm_loadu_si128((const __m128i *)_B_NIBBLE_LUT[1]);
+
+    for(uint32_t major = 0; major < _P_MAJOR_COUNT; major += 16)
     {
-        InitLUTs();
-        _initialized = true;
+        major = std::min(major, _P_MAJOR_COUNT - 16);
+
+        __m128i ecc_a = _mm_setzero_si128();
+        __m128i ecc_b = _mm_setzero_si128();
+        for(uint32_t minor = 0; minor < _P_MINOR_COUNT; ++minor)
+        {
+            __m128i temp = _mm_loadu_si128((const __m128i *)(data + major + minor * _P_MAJOR_COUNT));
+            ecc_a = gf_multiply(_mm_xor_si128(ecc_a, temp), f_lo, f_hi);
+            ecc_b = _mm_xor_si128(ecc_b, temp);
+        }
+
+        __m128i p = gf_multiply(_mm_xor_si128(gf_multiply(ecc_a, f_lo, f_hi), ecc_b), b_lo, b_hi);
+        _mm_storeu_si128((__m128i *)(parity + major), p);
+        _mm_storeu_si128((__m128i *)(parity + major + _P_MAJOR_COUNT), _mm_xor_si128(p, ecc_b));
     }
 }
 
 
+// Q diagonals wrap around the block, bytes are gathered into rows first using precomputed layout
+RI_TARGET("ssse3")
+void ECC::ComputeQBlockSIMD(uint8_t *parity, const uint8_t *data)
+{
+    const uint32_t MAJOR_COUNT_ALIGNED = 64;
+    alignas(16) uint8_t rows[_Q_MINOR_COUNT][MAJOR_COUNT_ALIGNED];
+    for(uint32_t minor = 0; minor < _Q_MINOR_COUNT; ++minor)
+    {
+        for(uint32_t n = 0; n < _Q_MAJOR_COUNT / 2; ++n)
+            memcpy(&rows[minor][n * 2], data + _Q_GATHER[minor][n], 2);
+        memset(&rows[minor][_Q_MAJOR_COUNT], 0, MAJOR_COUNT_ALIGNED - _Q_MAJOR_COUNT);
+    }
+
+    const __m128i f_lo = _mm_loadu_si128((const __m128i *)_F_NIBBLE_LUT[0]);
+    const __m128i f_hi = _mm_loadu_si128((const __m128i *)_F_NIBBLE_LUT[1]);
+    const __m128i b_lo = _mm_loadu_si128((const __m128i *)_B_NIBBLE_LUT[0]);
+    const __m128i b_hi = _mm_loadu_si128((const __m128i *)_B_NIBBLE_LUT[1]);
+
+    alignas(16) uint8_t p[MAJOR_COUNT_ALIGNED];
+    alignas(16) uint8_t q[MAJOR_COUNT_ALIGNED];
+    for(uint32_t major = 0; major < MAJOR_COUNT_ALIGNED; major += 16)
+    {
+        __m128i ecc_a = _mm_setzero_si128();
+        __m128i ecc_b = _mm_setzero_si128();
+        for(uint32_t minor = 0; minor < _Q_MINOR_COUNT; ++minor)
+        {
+            __m128i temp = _mm_load_si128((const __m128i *)&rows[minor][major]);
+            ecc_a = gf_multiply(_mm_xor_si128(ecc_a, temp), f_lo, f_hi);
+            ecc_b = _mm_xor_si128(ecc_b, temp);
+        }
+
+        __m128i v = gf_multiply(_mm_xor_si128(gf_multiply(ecc_a, f_lo, f_hi), ecc_b), b_lo, b_hi);
+        _mm_store_si128((__m128i *)&p[major], v);
+        _mm_store_si128((__m128i *)&q[major], _mm_xor_si128(v, ecc_b));
+    }
+
+    memcpy(parity, p, _Q_MAJOR_COUNT);
+    memcpy(parity + _Q_MAJOR_COUNT, q, _Q_MAJOR_COUNT);
+}
+
+#else
+
+void ECC::ComputePBlockSIMD(uint8_t *parity, const uint8_t *data)
+{
+    ComputeBlock(parity, data, _P_MAJOR_COUNT, _P_MINOR_COUNT, 2, 86);
+}
+
+
+void ECC::ComputeQBlockSIMD(uint8_t *parity, const uint8_t *data)
+{
+    ComputeBlock(parity, data, _Q_MAJOR_COUNT, _Q_MINOR_COUNT, 86, 88);
+}
+
+#endif
+
+
+uint32_t EDC::_LUT[_SLICES][_LUT_SIZE];
+std::once_flag EDC::_initialized;
+
+
+EDC::EDC()
+{
+    std::call_once(_initialized, [this]()
+                   {
+                       InitLUTs();
+                       SelfTest();
+                   });
+}
+
+
+// slicing-by-16, processes 16 bytes per iteration with independent table lookups
 uint32_t EDC::ComputeBlock(uint32_t edc, const uint8_t *data, uint32_t size)
+{
+    for(; size >= _SLICES; size -= _SLICES, data += _SLICES)
+    {
+        uint32_t w[4];
+        std::memcpy(w, data, sizeof(w));
+        w[0] ^= edc;
+
+        edc = _LUT[15][w[0] & 0xFF] ^ _LUT[14][w[0] >> 8 & 0xFF] ^ _LUT[13][w[0] >> 16 & 0xFF] ^ _LUT[12][w[0] >> 24]
+            ^ _LUT[11][w[1] & 0xFF] ^ _LUT[10][w[1] >> 8 & 0xFF] ^ _LUT[ 9][w[1] >> 16 & 0xFF] ^ _LUT[ 8][w[1] >> 24]
+            ^ _LUT[ 7][w[2] & 0xFF] ^ _LUT[ 6][w[2] >> 8 & 0xFF] ^ _LUT[ 5][w[2] >> 16 & 0xFF] ^ _LUT[ 4][w[2] >> 24]
+            ^ _LUT[ 3][w[3] & 0xFF] ^ _LUT[ 2][w[3] >> 8 & 0xFF] ^ _LUT[ 1][w[3] >> 16 & 0xFF] ^ _LUT[ 0][w[3] >> 24];
+    }
+
+    return ComputeBlockBytewise(edc, data, size);
+}
+
+
+uint32_t EDC::ComputeBlockBytewise(uint32_t edc, const uint8_t *data, uint32_t size)
 {
     while(size--)
-        edc = edc >> 8 ^ _LUT[(edc ^ *data++) & 0xFF];
+        edc = edc >> 8 ^ _LUT[0][(edc ^ *data++) & 0xFF];
     return edc;
 }
 
@@ -148,8 +333,37 @@ void EDC::InitLUTs()
         uint32_t edc = i;
         for(uint32_t j = 0; j < 8; ++j)
             edc = edc >> 1 ^ (edc & 1 ? 0xD8018001 : 0);
-        _LUT[i] = edc;
+        _LUT[0][i] = edc;
     }
+
+    // _LUT[n][i] is the EDC of byte i followed by n zero bytes
+    for(uint32_t n = 1; n < _SLICES; ++n)
+        for(uint32_t i = 0; i < _LUT_SIZE; ++i)
+            _LUT[n][i] = _LUT[n - 1][i] >> 8 ^ _LUT[0][_LUT[n - 1][i] & 0xFF];
+}
+
+
+// compare sliced computation against bytewise one for every sector EDC range
+void EDC::SelfTest()
+{
+    uint8_t data[sizeof(cdrom::Sector)];
+    uint32_t seed = 0x12345678;
+    for(auto &d : data)
+    {
+        seed = seed * 1103515245 + 12345;
+        d = seed >> 16;
+    }
+
+    const uint32_t sizes[] = {0, 1, 15, 16, 17, 2048, offsetof(cdrom::Sector, mode1.edc),
+        offsetof(cdrom::Sector, mode2.xa.form1.edc) - offsetof(cdrom::Sector, mode2.xa.sub_header),
+        offsetof(cdrom::Sector, mode2.xa.form2.edc) - offsetof(cdrom::Sector, mode2.xa.sub_header), sizeof(data)};
+    for(auto size : sizes)
+        for(uint32_t offset = 0; offset < 4; ++offset)
+        {
+            uint32_t s = std::min(size, (uint32_t)sizeof(data) - offset);
+            if(ComputeBlock(seed, data + offset, s) != ComputeBlockBytewise(seed, data + offset, s))
+                throw_line("EDC self-test failure");
+        }
 }
 
 }
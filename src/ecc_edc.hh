@@ -5,6 +5,7 @@
 
 
 #include <cstdint>
+#include <mutex>
 #include "cdrom.hh"
 
 
@@ -24,10 +25,26 @@ private:
     static const uint32_t _LUT_SIZE = 0x100;
     static uint8_t _F_LUT[_LUT_SIZE];
     static uint8_t _B_LUT[_LUT_SIZE];
-    static bool _initialized;
+    static std::once_flag _initialized;
+
+    // P: 86 columns x 24 rows, Q: 52 diagonals x 43 rows
+    static const uint32_t _P_MAJOR_COUNT = 86;
+    static const uint32_t _P_MINOR_COUNT = 24;
+    static const uint32_t _Q_MAJOR_COUNT = 52;
+    static const uint32_t _Q_MINOR_COUNT = 43;
+
+    // SIMD path: nibble tables for GF(2^8) multiplication and Q diagonal gather layout
+    static bool _simd;
+    static uint8_t _F_NIBBLE_LUT[2][16];
+    static uint8_t _B_NIBBLE_LUT[2][16];
+    static uint16_t _Q_GATHER[_Q_MINOR_COUNT][_Q_MAJOR_COUNT / 2];
 
     void InitLUTs();
+    void SelfTest();
+    void Compute(cdrom::Sector::ECC &ecc, const uint8_t *data, bool simd);
     void ComputeBlock(uint8_t *parity, const uint8_t *data, uint32_t major_count, uint32_t minor_count, uint32_t major_mult, uint32_t minor_inc);
+    void ComputePBlockSIMD(uint8_t *parity, const uint8_t *data);
+    void ComputeQBlockSIMD(uint8_t *parity, const uint8_t *data);
 };
 
 class EDC
@@ -39,10 +56,13 @@ public:
 
 private:
     static const uint32_t _LUT_SIZE = 0x100;
-    static uint32_t _LUT[_LUT_SIZE];
-    static bool _initialized;
+    static const uint32_t _SLICES = 16;
+    static uint32_t _LUT[_SLICES][_LUT_SIZE];
+    static std::once_flag _initialized;
 
     void InitLUTs();
+    static uint32_t ComputeBlockBytewise(uint32_t edc, const uint8_t *data, uint32_t size);
+    void SelfTest();
 };
 
 }
@@ -0,0 +1,165 @@
+#include <functional>
+#include <sstream>
+#include <sys/stat.h>
+#include <tuple>
+#include "common.hh"
+#include "hash_cache.hh"
+
+
+
+namespace redump_info
+{
+
+bool HashCache::Key::operator<(const Key &other) const
+{
+    return std::tie(device, inode, size, mtime_ns) < std::tie(other.device, other.inode, other.size, other.mtime_ns);
+}
+
+
+bool HashCache::Key::operator==(const Key &other) const
+{
+    return std::tie(device, inode, size, mtime_ns) == std::tie(other.device, other.inode, other.size, other.mtime_ns);
+}
+
+
+HashCache::HashCache(const std::filesystem::path &cache_path)
+{
+    // file is append only while running, drop overridden and damaged lines once on startup
+    if(std::filesystem::exists(cache_path) && Load(cache_path) > _entries.size())
+        Compact(cache_path);
+
+    // new entries are appended as soon as they are computed, an interrupted run keeps what was done
+    _ofs.open(cache_path, std::ios::app);
+    if(_ofs.fail())
+        throw_line("unable to open hash cache file (" + cache_path.generic_string() + ")");
+}
+
+
+HashCache::Key HashCache::FileKey(const std::filesystem::path &file_path)
+{
+    Key key;
+
+#ifdef _WIN32
+    struct _stat64 st;
+    if(_wstat64(file_path.c_str(), &st))
+        throw_line("unable to stat file (" + file_path.generic_string() + ")");
+
+    // no inode numbers on Windows, use full path instead
+    key.device = st.st_dev;
+    key.inode = std::hash<std::wstring>()(std::filesystem::absolute(file_path).wstring());
+    key.size = st.st_size;
+    key.mtime_ns = (int64_t)st.st_mtime * 1000000000;
+#else
+    struct stat st;
+    if(stat(file_path.c_str(), &st))
+        throw_line("unable to stat file (" + file_path.generic_string() + ")");
+
+    key.device = st.st_dev;
+    key.inode = st.st_ino;
+    key.size = st.st_size;
+#ifdef __APPLE__
+    key.mtime_ns = (int64_t)st.st_mtimespec.tv_sec * 1000000000 + st.st_mtimespec.tv_nsec;
+#else
+    key.mtime_ns = (int64_t)st.st_mtim.tv_sec * 1000000000 + st.st_mtim.tv_nsec;
+#endif
+#endif
+
+    return key;
+}
+
+
+bool HashCache::Find(Entry &entry, const Key &key) const
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+
+    auto it = _entries.find(key);
+    if(it == _entries.end())
+        return false;
+
+    entry = it->second;
+    return true;
+}
+
+
+void HashCache::Store(const Key &key, const Entry &entry)
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+
+    _entries[key] = entry;
+
+    Write(_ofs, key, entry);
+    _ofs.flush();
+}
+
+
+void HashCache::Write(std::ostream &os, const Key &key, const Entry &entry)
+{
+    os << key.device << ' ' << key.inode << ' ' << key.size << ' ' << key.mtime_ns << ' '
+        << std::hex << entry.crc << std::dec << ' ' << entry.md5 << ' ' << entry.sha1;
+    if(entry.verified)
+        os << ' ' << entry.verify_policy << ' ' << entry.errors << ' ' << entry.edc;
+    os << '\n';
+}
+
+
+// one entry per line, later lines override earlier ones
+// device inode size mtime_ns crc md5 sha1 [verify_policy errors edc]
+uint64_t HashCache::Load(const std::filesystem::path &cache_path)
+{
+    std::ifstream ifs(cache_path);
+    if(ifs.fail())
+        throw_line("unable to open hash cache file (" + cache_path.generic_string() + ")");
+
+    uint64_t lines = 0;
+    std::string line;
+    while(std::getline(ifs, line))
+    {
+        ++lines;
+        std::stringstream ss(line);
+
+        Key key;
+        Entry entry;
+        ss >> key.device >> key.inode >> key.size >> key.mtime_ns >> std::hex >> entry.crc >> std::dec >> entry.md5 >> entry.sha1;
+        // skip damaged line (interrupted write)
+        if(ss.fail() || entry.md5.size() != 32 || entry.sha1.size() != 40)
+            continue;
+
+        entry.verified = false;
+        entry.errors = 0;
+        entry.edc = false;
+        if(ss >> entry.verify_policy >> entry.errors >> entry.edc)
+            entry.verified = true;
+
+        _entries[key] = entry;
+    }
+
+    return lines;
+}
+
+
+// rewritten copy replaces the file atomically, on failure the old file is kept and appended to
+void HashCache::Compact(const std::filesystem::path &cache_path) const
+{
+    auto tmp_path = cache_path;
+    tmp_path += ".tmp";
+
+    std::error_code ec;
+    {
+        std::ofstream ofs(tmp_path, std::ofstream::trunc);
+        for(auto const &e : _entries)
+            Write(ofs, e.first, e.second);
+        ofs.close();
+
+        if(ofs.fail())
+        {
+            std::filesystem::remove(tmp_path, ec);
+            return;
+        }
+    }
+
+    std::filesystem::rename(tmp_path, cache_path, ec);
+    if(ec)
+        std::filesystem::remove(tmp_path, ec);
+}
+
+}
@@ -0,0 +1,65 @@
+#pragma once
+
+
+
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <map>
+#include <mutex>
+#include <string>
+
+
+
+namespace redump_info
+{
+
+// persistent store of track checksums, file is identified by it's device, inode, size and
+// modification time so renamed / moved files still hit and any modification invalidates the entry,
+// safe to use from multiple threads
+class HashCache
+{
+public:
+    struct Key
+    {
+        uint64_t device;
+        uint64_t inode;
+        uint64_t size;
+        int64_t mtime_ns;
+
+        bool operator<(const Key &other) const;
+        bool operator==(const Key &other) const;
+    };
+
+    struct Entry
+    {
+        uint32_t crc;
+        std::string md5;
+        std::string sha1;
+
+        // data track verification results, valid only if verified is set
+        bool verified;
+        std::string verify_policy;
+        uint32_t errors;
+        bool edc;
+    };
+
+    HashCache(const std::filesystem::path &cache_path);
+
+    static Key FileKey(const std::filesystem::path &file_path);
+
+    bool Find(Entry &entry, const Key &key) const;
+    void Store(const Key &key, const Entry &entry);
+
+private:
+    mutable std::mutex _mutex;
+    std::map<Key, Entry> _entries;
+    std::ofstream _ofs;
+
+    // returns number of lines read, including overridden and damaged ones
+    uint64_t Load(const std::filesystem::path &cache_path);
+    void Compact(const std::filesystem::path &cache_path) const;
+    static void Write(std::ostream &os, const Key &key, const Entry &entry);
+};
+
+}
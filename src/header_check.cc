@@ -0,0 +1,163 @@
+#include <cstddef>
+#include <cstring>
+#include "header_check.hh"
+
+#if defined(__SSE2__) || defined(_M_X64) || defined(_M_AMD64)
+#include <emmintrin.h>
+#define RI_HEADER_CHECK_SSE2
+#endif
+
+
+
+namespace redump_info
+{
+
+// MSF 00:02:00 is LBA 0
+static const int32_t LBA_START = -150;
+
+// sync and address bytes of the header
+static const uint32_t COMPARE_MASK = 0x7FFF;
+static const uint32_t SYNC_MASK = 0x0FFF;
+
+const uint8_t HeaderCheck::_SYNC[12] = { 0x00, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0x00 };
+
+
+static int32_t address_to_lba(const cdrom::Sector::Header::Address &address)
+{
+    return (int32_t)cdrom::msf_to_lba(address) + LBA_START;
+}
+
+
+HeaderCheck::HeaderCheck()
+    : _lba(0)
+    , _anchored(false)
+    , _index(0)
+    , _candidate(false)
+    , _candidateIndex(0)
+    , _candidateLba(0)
+    , _rangesEnd(0)
+    , _previous{}
+{
+    memcpy(_expected, _SYNC, sizeof(_SYNC));
+    memset(_expected + sizeof(_SYNC), 0, sizeof(_expected) - sizeof(_SYNC));
+}
+
+
+void HeaderCheck::Update(const cdrom::Sector *sectors, uint32_t count)
+{
+    static_assert(offsetof(cdrom::Sector, header) + sizeof(cdrom::Sector::Header) == 16, "unexpected sector header layout");
+
+#ifdef RI_HEADER_CHECK_SSE2
+    // one compare validates sync and address at once, only mismatching sectors take the slow path
+    for(uint32_t i = 0; i < count; ++i)
+    {
+        __m128i header = _mm_loadu_si128((const __m128i *)&sectors[i]);
+        __m128i expected = _mm_load_si128((const __m128i *)_expected);
+        uint32_t mask = (uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi8(header, expected));
+
+        if(_anchored && (mask & COMPARE_MASK) == COMPARE_MASK)
+        {
+            _previous = sectors[i].header.address;
+            Advance();
+        }
+        else
+            Mismatch(sectors[i], (mask & SYNC_MASK) == SYNC_MASK);
+    }
+#else
+    for(uint32_t i = 0; i < count; ++i)
+    {
+        auto header = (const uint8_t *)&sectors[i];
+
+        if(_anchored && !memcmp(header, _expected, offsetof(cdrom::Sector, header.mode)))
+        {
+            _previous = sectors[i].header.address;
+            Advance();
+        }
+        else
+            Mismatch(sectors[i], !memcmp(header, _SYNC, sizeof(_SYNC)));
+    }
+#endif
+}
+
+
+const std::vector<HeaderCheck::Range> &HeaderCheck::Ranges() const
+{
+    return _ranges;
+}
+
+
+bool HeaderCheck::SyncFound() const
+{
+    return _anchored;
+}
+
+
+void HeaderCheck::Advance()
+{
+    ++_index;
+    ++_lba;
+
+    auto address = cdrom::lba_to_msf((uint32_t)(_lba - LBA_START));
+    memcpy(_expected + offsetof(cdrom::Sector, header.address), &address, sizeof(address));
+}
+
+
+void HeaderCheck::Mismatch(const cdrom::Sector &sector, bool sync)
+{
+    if(sync)
+    {
+        auto &address = sector.header.address;
+        int32_t lba = address_to_lba(address);
+
+        // leading sectors without sync were recorded by index, now their LBA is known
+        if(!_anchored)
+        {
+            for(auto &r : _ranges)
+                r.lba = (int32_t)r.index + lba - (int32_t)_index;
+            _anchored = true;
+            _lba = lba;
+        }
+        // previous sector started a new sequence and this one follows it, continue from there
+        else if(_candidate && _candidateIndex + 1 == _index && lba == _candidateLba + 1)
+        {
+            _candidate = false;
+            _lba = lba;
+        }
+        // expected address is kept, if only this header is damaged the next sector matches again
+        else
+        {
+            bool repeat = !memcmp(&address, &_previous, sizeof(address));
+            AddRange(repeat ? Error::REPEAT : Error::JUMP, lba);
+
+            _candidate = true;
+            _candidateIndex = _index;
+            _candidateLba = lba;
+        }
+
+        _previous = address;
+    }
+    else
+        AddRange(Error::MISSING, 0);
+
+    Advance();
+}
+
+
+void HeaderCheck::AddRange(Error error, int32_t address)
+{
+    if(!_ranges.empty() && _rangesEnd == _index)
+    {
+        auto &r = _ranges.back();
+        if(r.error == error && (error == Error::MISSING || (error == Error::REPEAT && r.address == address)))
+        {
+            ++r.count;
+            ++_rangesEnd;
+            return;
+        }
+    }
+
+    _ranges.push_back(Range{error, _index, _anchored ? _lba : (int32_t)_index, 1, address});
+    _rangesEnd = _index + 1;
+}
+
+}
@@ -0,0 +1,73 @@
+#pragma once
+
+
+
+#include <cstdint>
+#include <vector>
+#include "cdrom.hh"
+
+
+
+namespace redump_info
+{
+
+// validates sync pattern and MSF address continuity of consecutive sectors,
+// expected LBA is anchored to the first valid header and re-anchored only when the sector
+// following a mismatch confirms the new address, a single corrupted header is one error
+class HeaderCheck
+{
+public:
+    enum class Error
+    {
+        // sync pattern mismatch
+        MISSING,
+        // same address as the previous sector
+        REPEAT,
+        // address doesn't follow the previous sector
+        JUMP
+    };
+
+    struct Range
+    {
+        Error error;
+        // track sector index of the first sector in range
+        uint32_t index;
+        // expected LBA of the first sector in range
+        int32_t lba;
+        uint32_t count;
+        // LBA decoded from the header of the first sector in range, REPEAT and JUMP only
+        int32_t address;
+    };
+
+    HeaderCheck();
+
+    void Update(const cdrom::Sector *sectors, uint32_t count);
+
+    const std::vector<Range> &Ranges() const;
+    // false if none of the sectors had a sync, such track is not a data track
+    bool SyncFound() const;
+
+private:
+    static const uint8_t _SYNC[12];
+
+    // sync followed by the expected address, mode byte isn't compared
+    alignas(16) uint8_t _expected[16];
+    // expected LBA of the current sector, valid once the first sector with a sync is found
+    int32_t _lba;
+    bool _anchored;
+    uint32_t _index;
+    // address of the last mismatching sector, becomes the new anchor if the next sector follows it
+    bool _candidate;
+    uint32_t _candidateIndex;
+    int32_t _candidateLba;
+    // sector index past the last range, used to merge adjacent errors
+    uint32_t _rangesEnd;
+    cdrom::Sector::Header::Address _previous;
+    std::vector<Range> _ranges;
+
+    void Advance();
+    void Mismatch(const cdrom::Sector &sector, bool sync);
+    void AddRange(Error error, int32_t address);
+};
+
+}
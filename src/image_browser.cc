@@ -1,14 +1,21 @@
 #include <algorithm>
+#include <atomic>
+#include <condition_variable>
 #include <cstring>
+#include <fstream>
 #include <functional>
 #include <iomanip>
 #include <locale>
+#include <mutex>
+#include <random>
+#include <set>
 #include <sstream>
 #include <stdexcept>
 #include <vector>
 #include "common.hh"
 #include "endian.hh"
 #include "strings.hh"
+#include "thread_pool.hh"
 #include "image_browser.hh"
 
 
@@ -20,15 +27,31 @@
 namespace redump_info
 {
 
-//FIXME: reorganize so no code duplication in ImageBrowser::ImageBrowser()
-bool ImageBrowser::IsDataTrack(const std::filesystem::path &track)
+// index cache file is a raw dump of the directory tree in native byte order,
+// any layout change has to bump the version
+struct IndexCacheHeader
 {
-    std::ifstream ifs(track, std::ifstream::binary);
+    char magic[4];
+    uint32_t version;
+    // track file identification
+    uint64_t size;
+    int64_t mtime_ns;
+    uint32_t node_size;
+    uint32_t track_offset;
+    uint32_t nodes_count;
+    uint32_t strings_size;
+};
+
+static const char INDEX_CACHE_MAGIC[4] = { 'R', 'I', 'D', 'X' };
+static const uint32_t INDEX_CACHE_VERSION = 1;
 
-    if(ifs.fail())
-        return false;
 
-    uint64_t size = std::filesystem::file_size(track);
+bool ImageBrowser::IsDataTrack(const std::filesystem::path &track)
+{
+    std::error_code ec;
+    uint64_t size = std::filesystem::file_size(track, ec);
+    if(ec)
+        return false;
 
     if(size % sizeof(cdrom::Sector))
         return false;
@@ -36,29 +59,86 @@ bool ImageBrowser::IsDataTrack(const std::filesystem::path &track)
     if(size < ((uint64_t)iso9660::SYSTEM_AREA_SIZE + 1) * sizeof(cdrom::Sector))
         return false;
 
-    // skip system area
-    ifs.seekg(iso9660::SYSTEM_AREA_SIZE * sizeof(cdrom::Sector));
-    if(ifs.fail())
+    // probing reads a few sectors of every candidate, positional reads are enough and can't fault
+    std::unique_ptr<SectorSource> source;
+    try
+    {
+        source = SectorSource::Open(track);
+    }
+    catch(const std::exception &)
+    {
         return false;
+    }
+
+    iso9660::VolumeDescriptor pvd;
+    return FindPVD(pvd, *source);
+}
+
+
+ImageBrowser::ImageBrowser(const std::filesystem::path &data_track, std::shared_ptr<const SectorMap> sector_map, uint32_t jobs,
+                           const std::filesystem::path &index_cache, bool mapped)
+	: _source(SectorSource::Open(data_track, mapped))
+	, _sectorMap(sector_map)
+	, _jobs(jobs)
+	, _indexed(false)
+	, _pathsIndexed(false)
+{
+	uint64_t size = std::filesystem::file_size(data_track);
+
+	if(size % sizeof(cdrom::Sector))
+		throw_line("file is not a RAW dump (multiple of 2352 bytes)");
+
+    if(size < ((uint64_t)iso9660::SYSTEM_AREA_SIZE + 1) * sizeof(cdrom::Sector))
+        throw_line("file is too small");
+
+    // calculate data track sector offset
+    cdrom::Sector buffer;
+    auto sector = _source->Sector(buffer, 0);
+    if(sector == nullptr)
+        throw_line(std::string("read failure (") + std::strerror(errno) + ")");
+    _trackOffset = msf_to_lba(sector->header.address) - msf_to_lba(cdrom::Sector::Header::Address{0, 2, 0});
 
-    // find primary volume descriptor
-    iso9660::VolumeDescriptor *pvd = nullptr;
-    for(;;)
+	if(!FindPVD(_pvd, *_source))
+		throw_line("primary volume descriptor not found");
+
+    _trackSize = _source->SectorsCount();
+
+    if(!index_cache.empty())
     {
-        cdrom::Sector sector;
-        ifs.read((char *)&sector, sizeof(sector));
-        if(ifs.fail())
+        // named after the file identity same as hash cache, renamed / moved track still hits
+        _trackKey = HashCache::FileKey(data_track);
+        std::stringstream ss;
+        ss << std::hex << _trackKey.device << '_' << _trackKey.inode << ".ridx";
+        _indexCachePath = index_cache / ss.str();
+
+        _indexed = LoadIndex();
+    }
+}
+
+
+// pool type is complete only here
+ImageBrowser::~ImageBrowser() = default;
+
+
+bool ImageBrowser::FindPVD(iso9660::VolumeDescriptor &pvd, SectorSource &source)
+{
+    // skip system area
+    for(uint32_t i = iso9660::SYSTEM_AREA_SIZE; i < source.SectorsCount(); ++i)
+    {
+        cdrom::Sector buffer;
+        auto sector = source.Sector(buffer, i);
+        if(sector == nullptr)
             break;
 
-        iso9660::VolumeDescriptor *vd;
-        switch(sector.header.mode)
+        const iso9660::VolumeDescriptor *vd;
+        switch(sector->header.mode)
         {
         case 1:
-            vd = (iso9660::VolumeDescriptor *)sector.mode1.user_data;
+            vd = (const iso9660::VolumeDescriptor *)sector->mode1.user_data;
             break;
 
         case 2:
-            vd = (iso9660::VolumeDescriptor *)sector.mode2.xa.form1.user_data;
+            vd = (const iso9660::VolumeDescriptor *)sector->mode2.xa.form1.user_data;
             break;
 
         default:
@@ -71,288 +151,737 @@ bool ImageBrowser::IsDataTrack(const std::filesystem::path &track)
 
         if(vd->type == iso9660::VolumeDescriptor::Type::PRIMARY)
         {
-            pvd = vd;
-            break;
+            pvd = *vd;
+            return true;
         }
         else if(vd->type == iso9660::VolumeDescriptor::Type::SET_TERMINATOR)
             break;
     }
 
-    return pvd != nullptr;
+    return false;
 }
 
 
-ImageBrowser::ImageBrowser(const std::filesystem::path &data_track)
-	: _ifs(data_track, std::ifstream::binary)
+ImageBrowser::Entry ImageBrowser::RootDirectory()
 {
-	if(_ifs.fail())
-		throw_line("unable to open file (" + std::strerror(errno) + ")");
+	Nodes();
 
-	uint64_t size = std::filesystem::file_size(data_track);
+	return Entry(*this, ROOT_INDEX);
+}
 
-	if(size % sizeof(cdrom::Sector))
-		throw_line("file is not a RAW dump (multiple of 2352 bytes)");
 
-    if(size < ((uint64_t)iso9660::SYSTEM_AREA_SIZE + 1) * sizeof(cdrom::Sector))
-        throw_line("file is too small");
+const iso9660::VolumeDescriptor &ImageBrowser::GetPVD() const
+{
+    return _pvd;
+}
 
-    cdrom::Sector sector;
 
-    // calculate data track sector offset
-    _ifs.read((char *)&sector, sizeof(sector));
-    _trackOffset = msf_to_lba(sector.header.address) - msf_to_lba(cdrom::Sector::Header::Address{0, 2, 0});
+const std::vector<ImageBrowser::Node> &ImageBrowser::Nodes()
+{
+    if(!_indexed)
+    {
+        BuildIndex();
+        _indexed = true;
 
-	// skip system area
-	_ifs.seekg(iso9660::SYSTEM_AREA_SIZE * sizeof(cdrom::Sector));
-    if(_ifs.fail())
-        throw_line("seek failure");
+        // cache is only an optimization, failure to store it doesn't affect processing
+        if(!_indexCachePath.empty())
+            StoreIndex();
+    }
 
-	// find primary volume descriptor
-	iso9660::VolumeDescriptor *pvd = nullptr;
-	for(;;)
-	{
-		_ifs.read((char *)&sector, sizeof(sector));
-        if(_ifs.fail())
-            break;
+    return _nodes;
+}
 
-        iso9660::VolumeDescriptor *vd;
-        switch(sector.header.mode)
-        {
-        case 1:
-            vd = (iso9660::VolumeDescriptor *)sector.mode1.user_data;
-            break;
 
-        case 2:
-            vd = (iso9660::VolumeDescriptor *)sector.mode2.xa.form1.user_data;
-            break;
+void ImageBrowser::BuildIndex()
+{
+    // path table allows to read all directories sequentially, directory records are authoritative
+    // and if the two disagree, directories are read one by one while traversing the records
+    std::map<uint32_t, std::vector<uint8_t>> directories;
+    if(!ReadPathTableDirectories(directories) || !BuildIndex(&directories))
+        BuildIndex(nullptr);
+}
 
-        default:
-            continue;
-        }
 
-        if(memcmp(vd->standard_identifier, iso9660::STANDARD_INDENTIFIER, sizeof(vd->standard_identifier)) &&
-           memcmp(vd->standard_identifier, iso9660::CDI_STANDARD_INDENTIFIER, sizeof(vd->standard_identifier)))
-            break;
+bool ImageBrowser::LoadIndex()
+{
+    static_assert(std::is_trivially_copyable<Node>::value, "node has to be trivially copyable");
 
-		if(vd->type == iso9660::VolumeDescriptor::Type::PRIMARY)
-		{
-			pvd = vd;
-			break;
-		}
-		else if(vd->type == iso9660::VolumeDescriptor::Type::SET_TERMINATOR)
-			break;
-	}
+    std::error_code ec;
+    uint64_t file_size = std::filesystem::file_size(_indexCachePath, ec);
+    if(ec)
+        return false;
 
-	if(pvd == nullptr)
-		throw_line("primary volume descriptor not found");
+    std::ifstream ifs(_indexCachePath, std::ios::binary);
+    if(ifs.fail())
+        return false;
 
-	_pvd = *pvd;
-    _trackSize = (uint32_t)(size / sizeof(cdrom::Sector));
-}
+    IndexCacheHeader header;
+    ifs.read((char *)&header, sizeof(header));
+    if(ifs.fail() || memcmp(header.magic, INDEX_CACHE_MAGIC, sizeof(INDEX_CACHE_MAGIC)) || header.version != INDEX_CACHE_VERSION
+       || header.size != _trackKey.size || header.mtime_ns != _trackKey.mtime_ns || header.node_size != sizeof(Node)
+       || header.track_offset != _trackOffset || !header.nodes_count)
+        return false;
 
+    if(file_size != sizeof(header) + sizeof(_pvd) + (uint64_t)header.nodes_count * sizeof(Node) + header.strings_size)
+        return false;
 
-std::shared_ptr<ImageBrowser::Entry> ImageBrowser::RootDirectory()
-{
-	return std::shared_ptr<Entry>(new Entry(*this, std::string(""), 1, _pvd.primary.root_directory_record));
-}
+    // stale if volume descriptor differs
+    iso9660::VolumeDescriptor pvd;
+    ifs.read((char *)&pvd, sizeof(pvd));
+    if(ifs.fail() || memcmp(&pvd, &_pvd, sizeof(pvd)))
+        return false;
 
+    _nodes.resize(header.nodes_count);
+    ifs.read((char *)_nodes.data(), (std::streamsize)_nodes.size() * sizeof(Node));
+    _strings.resize(header.strings_size);
+    ifs.read(_strings.data(), (std::streamsize)_strings.size());
+    // damaged file would otherwise lead to out of bounds access
+    if(ifs.fail() || !IndexValid())
+    {
+        _nodes.clear();
+        _strings.clear();
+        return false;
+    }
 
-const iso9660::VolumeDescriptor &ImageBrowser::GetPVD() const
-{
-    return _pvd;
+    return true;
 }
 
 
-ImageBrowser::Entry::Entry(ImageBrowser &browser, const std::string &name, uint32_t version, const iso9660::DirectoryRecord &directory_record)
-	: _browser(browser)
-    , _name(name)
-	, _version(version)
-	, _directory_record(directory_record)
+bool ImageBrowser::StoreIndex() const
 {
-	;
+    std::error_code ec;
+
+    // written aside and renamed so that concurrent runs never see a partial file
+    auto tmp_path(_indexCachePath);
+    try
+    {
+        tmp_path += "." + std::to_string(std::random_device()()) + ".tmp";
+    }
+    catch(const std::exception &)
+    {
+        return false;
+    }
+
+    {
+        std::ofstream ofs(tmp_path, std::ios::binary);
+        if(ofs.fail())
+            return false;
+
+        IndexCacheHeader header{};
+        memcpy(header.magic, INDEX_CACHE_MAGIC, sizeof(INDEX_CACHE_MAGIC));
+        header.version = INDEX_CACHE_VERSION;
+        header.size = _trackKey.size;
+        header.mtime_ns = _trackKey.mtime_ns;
+        header.node_size = sizeof(Node);
+        header.track_offset = _trackOffset;
+        header.nodes_count = (uint32_t)_nodes.size();
+        header.strings_size = (uint32_t)_strings.size();
+
+        ofs.write((const char *)&header, sizeof(header));
+        ofs.write((const char *)&_pvd, sizeof(_pvd));
+        ofs.write((const char *)_nodes.data(), (std::streamsize)_nodes.size() * sizeof(Node));
+        ofs.write(_strings.data(), (std::streamsize)_strings.size());
+        ofs.close();
+        if(ofs.fail())
+        {
+            std::filesystem::remove(tmp_path, ec);
+            return false;
+        }
+    }
+
+    std::filesystem::rename(tmp_path, _indexCachePath, ec);
+    if(ec)
+    {
+        std::filesystem::remove(tmp_path, ec);
+        return false;
+    }
+
+    return true;
 }
 
 
-bool ImageBrowser::Entry::IsDirectory() const
+bool ImageBrowser::IndexValid() const
 {
-	return _directory_record.file_flags & (uint8_t)iso9660::DirectoryRecord::FileFlags::DIRECTORY;
+    // nodes are in breadth first order, parent and children references can't point backwards
+    for(uint32_t i = 0; i < (uint32_t)_nodes.size(); ++i)
+    {
+        auto &n = _nodes[i];
+
+        if(i == ROOT_INDEX ? n.parent != ROOT_INDEX : n.parent >= i)
+            return false;
+
+        if((uint64_t)n.name_offset + n.name_length > _strings.size() || (uint64_t)n.path_offset + n.path_length > _strings.size())
+            return false;
+
+        if(n.children_count && (n.children_offset <= i || (uint64_t)n.children_offset + n.children_count > _nodes.size()))
+            return false;
+    }
+
+    return true;
 }
 
 
-std::list<std::shared_ptr<ImageBrowser::Entry>> ImageBrowser::Entry::Entries()
+bool ImageBrowser::BuildIndex(const std::map<uint32_t, std::vector<uint8_t>> *directories)
 {
-	std::list<std::shared_ptr<ImageBrowser::Entry>> entries;
+    _nodes.clear();
+    _strings.clear();
 
-	if(IsDirectory())
-	{
-		// read whole directory record to memory
-		std::vector<uint8_t> buffer(Read(false, true));
-
-		for(uint32_t i = 0, n = (uint32_t)buffer.size(); i < n;)
-		{
-			iso9660::DirectoryRecord &dr = *(iso9660::DirectoryRecord *)&buffer[i];
-
-			if(dr.length && dr.length <= cdrom::FORM1_DATA_SIZE - i % cdrom::FORM1_DATA_SIZE)
-			{
-                // (1) [1/12/2020]: "All Star Racing 2 (Europe) (Track 1).bin"
-                // (4) [9/05/2021]: "All Star Racing 2 (USA) (Track 1).bin"
-                // (2) [1/21/2020]: "Aitakute... - Your Smiles in My Heart - Oroshitate no Diary - Introduction Disc (Japan) (Track 1).bin"
-                // (3) [1/21/2020]: "MLB 2005 (USA).bin"
-                // all these tracks have messed up directory records, (1) and (3) have garbage after valid entries, (2) has garbage before
-                // good DirectoryRecord validity trick is to compare lsb to msb for offset and data_length and make sure it's the same
-                if(dr.offset.lsb != endian_swap(dr.offset.msb) || dr.data_length.lsb != endian_swap(dr.data_length.msb))
+    Node root{};
+    root.directory_record = _pvd.primary.root_directory_record;
+    root.version = 1;
+    root.parent = ROOT_INDEX;
+    root.name_offset = AddString("");
+    root.path_offset = root.name_offset;
+    _nodes.push_back(root);
+
+    uint32_t directories_used = 0;
+
+    // nodes are appended while being traversed which results in breadth first order
+    for(uint32_t i = ROOT_INDEX; i < (uint32_t)_nodes.size(); ++i)
+    {
+        if(!(_nodes[i].directory_record.file_flags & (uint8_t)iso9660::DirectoryRecord::FileFlags::DIRECTORY))
+            continue;
+
+        uint32_t children_offset = (uint32_t)_nodes.size();
+        _nodes[i].children_offset = children_offset;
+
+        // directory pointing to one of it's parents would be traversed endlessly
+        bool loop = false;
+        for(uint32_t p = i; p != ROOT_INDEX && !loop;)
+        {
+            p = _nodes[p].parent;
+            loop = _nodes[p].directory_record.offset.lsb == _nodes[i].directory_record.offset.lsb;
+        }
+        if(loop)
+            continue;
+
+        const std::vector<uint8_t> *prefetched = nullptr;
+        if(directories != nullptr)
+        {
+            auto it = directories->find(_nodes[i].directory_record.offset.lsb);
+            if(it == directories->end() || it->second.size() != _nodes[i].directory_record.data_length.lsb)
+                return false;
+            prefetched = &it->second;
+            ++directories_used;
+        }
+
+        // errors are deferred until the directory is accessed
+        try
+        {
+            // read whole directory record to memory
+            std::vector<uint8_t> buffer(prefetched == nullptr ? Entry(*this, i).Read(false, true) : *prefetched);
+
+            for(uint32_t j = 0, n = (uint32_t)buffer.size(); j < n;)
+            {
+                iso9660::DirectoryRecord &dr = *(iso9660::DirectoryRecord *)&buffer[j];
+
+                if(dr.length && dr.length <= cdrom::FORM1_DATA_SIZE - j % cdrom::FORM1_DATA_SIZE)
                 {
+                    // (1) [1/12/2020]: "All Star Racing 2 (Europe) (Track 1).bin"
+                    // (4) [9/05/2021]: "All Star Racing 2 (USA) (Track 1).bin"
+                    // (2) [1/21/2020]: "Aitakute... - Your Smiles in My Heart - Oroshitate no Diary - Introduction Disc (Japan) (Track 1).bin"
+                    // (3) [1/21/2020]: "MLB 2005 (USA).bin"
+                    // all these tracks have messed up directory records, (1) and (3) have garbage after valid entries, (2) has garbage before
+                    // good DirectoryRecord validity trick is to compare lsb to msb for offset and data_length and make sure it's the same
+                    if(dr.offset.lsb != endian_swap(dr.offset.msb) || dr.data_length.lsb != endian_swap(dr.data_length.msb))
+                    {
 #ifdef DIRECTORY_RECORD_WORKAROUNDS
-                    //FIXME: doesn't work for (4)
-//                    ++i;
-//                    continue;
-                    // skip whole record
-                    break;
+                        //FIXME: doesn't work for (4)
+//                        ++j;
+//                        continue;
+                        // skip whole record
+                        break;
 
 #else
-                    throw_line("garbage in directory record");
+                        throw_line("garbage in directory record");
 #endif
+                    }
+
+                    char b1 = (char)buffer[j + sizeof(dr)];
+                    if(b1 != (char)iso9660::Characters::DIR_CURRENT && b1 != (char)iso9660::Characters::DIR_PARENT)
+                    {
+                        std::string_view identifier((const char *)&buffer[j + sizeof(dr)], dr.file_identifier_length);
+                        auto s = identifier.find((char)iso9660::Characters::SEPARATOR2);
+                        std::string_view name(s == std::string_view::npos ? identifier : identifier.substr(0, s));
+
+                        Node node{};
+                        node.directory_record = dr;
+                        node.version = s == std::string_view::npos ? 1 : std::stoi(std::string(identifier.substr(s + 1)));
+                        node.parent = i;
+                        node.name_offset = AddString(name);
+                        node.name_length = (uint32_t)name.size();
+                        if(dr.file_flags & (uint8_t)iso9660::DirectoryRecord::FileFlags::DIRECTORY)
+                        {
+                            auto &parent = _nodes[i];
+                            std::string path(String(parent.path_offset, parent.path_length));
+                            path += (path.empty() ? "" : "/") + std::string(name);
+                            node.path_offset = AddString(path);
+                            node.path_length = (uint32_t)path.size();
+                        }
+                        _nodes.push_back(node);
+                    }
+
+                    j += dr.length;
                 }
+                // skip sector boundary
+                else
+                    j = ((j / cdrom::FORM1_DATA_SIZE) + 1) * cdrom::FORM1_DATA_SIZE;
+            }
+        }
+        catch(const std::exception &)
+        {
+            _nodes.resize(children_offset);
+            _nodes[i].unreadable = true;
+        }
 
-				char b1 = (char)buffer[i + sizeof(dr)];
-				if(b1 != (char)iso9660::Characters::DIR_CURRENT && b1 != (char)iso9660::Characters::DIR_PARENT)
-				{
-					std::string identifier((const char *)& buffer[i + sizeof(dr)], dr.file_identifier_length);
-					auto s = identifier.find((char)iso9660::Characters::SEPARATOR2);
-					std::string name(s == std::string::npos ? identifier : identifier.substr(0, s));
-
-					uint32_t version(s == std::string::npos ? 1 : std::stoi(identifier.substr(s + 1)));
-
-//					entries.push_back(std::make_shared<Entry>(name, version, dr, _ifs));
-                    entries.push_back(std::shared_ptr<Entry>(new Entry(_browser, name, version, dr)));
-				}
-
-				i += dr.length;
-			}
-			// skip sector boundary
-			else
-				i = ((i / cdrom::FORM1_DATA_SIZE) + 1) * cdrom::FORM1_DATA_SIZE;
-		}
-	}
+        _nodes[i].children_count = (uint32_t)_nodes.size() - children_offset;
+    }
 
-	return entries;
+    // path table lists directories that are not reachable through directory records
+    return directories == nullptr || directories_used == directories->size();
 }
 
 
-std::shared_ptr<ImageBrowser::Entry> ImageBrowser::Entry::SubEntry(const std::filesystem::path &path)
+bool ImageBrowser::ReadPathTableDirectories(std::map<uint32_t, std::vector<uint8_t>> &directories)
 {
-	std::shared_ptr<Entry> entry;
+    uint32_t table_size = _pvd.primary.path_table_size.lsb;
+    if(!table_size || table_size != endian_swap(_pvd.primary.path_table_size.msb))
+        return false;
 
-    std::filesystem::path path_case(str_uppercase(path.generic_string()));
+    try
+    {
+        // type L path table is little endian, type M is the big endian copy of it
+        bool big_endian = false;
+        std::vector<uint8_t> table;
+        try
+        {
+            table = ReadExtent(_pvd.primary.type_l_path_table_offset, table_size, false, true);
+        }
+        catch(const std::exception &)
+        {
+            table = ReadExtent(endian_swap(_pvd.primary.type_m_path_table_offset), table_size, false, true);
+            big_endian = true;
+        }
+        if(table.size() != table_size)
+            return false;
 
-    for(auto const &p : path_case)
+        std::set<uint32_t> extents;
+        for(uint32_t i = 0; i + sizeof(iso9660::PathRecord) <= table_size;)
+        {
+            auto &pr = *(const iso9660::PathRecord *)&table[i];
+            if(!pr.length)
+                break;
+
+            extents.insert(big_endian ? endian_swap(pr.offset) : pr.offset);
+
+            i += sizeof(pr) + pr.length + pr.length % 2;
+        }
+
+        // first record is always the root directory
+        if(extents.find(_pvd.primary.root_directory_record.offset.lsb) == extents.end())
+            return false;
+
+        // extent size is known only from the first record of the directory itself
+        std::vector<uint32_t> lbas(extents.begin(), extents.end());
+        std::vector<std::vector<uint8_t>> data(lbas.size());
+        auto read = [&](uint32_t i)
+        {
+            data[i] = ReadExtent(lbas[i], cdrom::FORM1_DATA_SIZE, false, true);
+            if(data[i].size() < sizeof(iso9660::DirectoryRecord))
+                throw_line("directory extent is too small");
+
+            auto &dr = *(const iso9660::DirectoryRecord *)data[i].data();
+            if(dr.offset.lsb != lbas[i] || dr.data_length.lsb != endian_swap(dr.data_length.msb))
+                throw_line("directory extent doesn't start with current directory record");
+
+            if(dr.data_length.lsb > cdrom::FORM1_DATA_SIZE)
+                data[i] = ReadExtent(lbas[i], dr.data_length.lsb, false, true);
+            else
+                data[i].resize(dr.data_length.lsb);
+        };
+
+        // workers process batches of neighbouring extents so reads stay sequential
+        if(_jobs == 1)
+        {
+            for(uint32_t i = 0; i < (uint32_t)lbas.size(); ++i)
+                read(i);
+        }
+        else
+            RunParallel((uint32_t)lbas.size(), Delivery::UNORDERED, read, [](uint32_t) { return false; });
+
+        for(uint32_t i = 0; i < (uint32_t)lbas.size(); ++i)
+            directories.emplace(lbas[i], std::move(data[i]));
+    }
+    catch(const std::exception &)
+    {
+        return false;
+    }
+
+    return true;
+}
+
+
+std::vector<ImageBrowser::SectorRun> ImageBrowser::SectorRuns(uint32_t index, bool form2, uint32_t first, uint32_t count)
+{
+    SectorIndex *p;
+    {
+        std::lock_guard<std::mutex> lock(_sectorIndexesMutex);
+        p = &_sectorIndexes[{index, form2}];
+    }
+    auto &sector_index = *p;
+
+    // concurrent readers of the same file wait while its index is being extended
+    std::lock_guard<std::mutex> lock(sector_index.mutex);
+    auto &runs = sector_index.runs;
+
+    auto &dr = Nodes()[index].directory_record;
+    uint32_t offset = dr.offset.lsb - _trackOffset;
+    uint32_t size = dr.data_length.lsb;
+    uint32_t sectors_count = size / cdrom::FORM1_DATA_SIZE + (size % cdrom::FORM1_DATA_SIZE ? 1 : 0);
+
+    auto add_sector = [&](uint32_t s)
+    {
+        if(!runs.empty() && runs.back().offset + runs.back().count == offset + s)
+            ++runs.back().count;
+        else
+            runs.push_back(SectorRun{sector_index.data_sectors, offset + s, 1});
+        ++sector_index.data_sectors;
+    };
+
+    // classify file sectors until the last requested data sector is found
+    uint64_t end = (uint64_t)first + count;
+    bool mapped = _sectorMap && offset < _sectorMap->Size() && sectors_count <= _sectorMap->Size() - offset;
+    std::unique_ptr<cdrom::Sector[]> buffer;
+    while(!sector_index.complete && sector_index.data_sectors < end)
     {
-        auto directories = entry ? entry->Entries() : Entries();
-        bool found = false;
-        for(auto &d : directories)
+        uint32_t s = sector_index.sectors_scanned;
+        uint32_t batch = std::min(sectors_count - s, READ_BATCH_SECTORS);
+
+        // sector map is enough to tell the form, otherwise headers have to be read
+        if(mapped)
         {
-            std::string name_case(str_uppercase(d->Name()));
-            if(name_case == p || (name_case + ';' + std::to_string(d->Version())) == p)
+            for(uint32_t i = 0; i < batch; ++i)
             {
-                entry = d;
-                found = true;
-                break;
+                uint8_t form = _sectorMap->FileForm(offset + s + i);
+                if(form && (form == 2) == form2)
+                    add_sector(s + i);
             }
         }
-
-        if(!found)
+        else if(batch)
         {
-            entry.reset();
-            break;
+            if(!buffer)
+                buffer.reset(new cdrom::Sector[READ_BATCH_SECTORS]);
+
+            auto sectors = _source->Sectors(buffer.get(), offset + s, batch);
+            for(uint32_t i = 0; i < batch; ++i)
+            {
+                auto &header = sectors[i].header;
+                if((header.mode == 1 && !form2) || (header.mode == 2 && !(sectors[i].mode2.xa.sub_header.submode & (uint8_t)cdrom::CDXAMode::FORM2) == !form2))
+                    add_sector(s + i);
+            }
+
+            // data past unreadable sector isn't reachable, same as with sequential read
+            if(!batch)
+                sector_index.complete = true;
         }
+
+        sector_index.sectors_scanned += batch;
+        if(sector_index.sectors_scanned == sectors_count)
+            sector_index.complete = true;
     }
 
-	return entry;
+    // requested part of the runs
+    std::vector<SectorRun> range;
+    auto run = std::upper_bound(runs.begin(), runs.end(), first, [](uint32_t value, const SectorRun &r) { return value < r.data_sector; });
+    if(run != runs.begin())
+        --run;
+    for(; run != runs.end() && run->data_sector < end; ++run)
+    {
+        uint32_t skip = first > run->data_sector ? first - run->data_sector : 0;
+        if(skip >= run->count)
+            continue;
+
+        uint32_t n = (uint32_t)std::min<uint64_t>(run->count - skip, end - run->data_sector - skip);
+        range.push_back(SectorRun{run->data_sector + skip, run->offset + skip, n});
+    }
+
+    return range;
 }
 
 
-const std::string &ImageBrowser::Entry::Name() const
+const std::unordered_map<ImageBrowser::PathKey, uint32_t, ImageBrowser::PathKeyHash> &ImageBrowser::Paths()
 {
-	return _name;
+    if(!_pathsIndexed)
+    {
+        BuildPaths();
+        _pathsIndexed = true;
+    }
+
+    return _paths;
 }
 
 
-uint32_t ImageBrowser::Entry::Version() const
+void ImageBrowser::BuildPaths()
 {
-	return _version;
+    auto &nodes = Nodes();
+
+    // both key strings of every node are stored back to back: NAME followed by NAME;VERSION,
+    // views are taken after the arena is complete as it reallocates while growing
+    std::vector<uint32_t> offsets(nodes.size());
+    _pathStrings.clear();
+    for(uint32_t i = ROOT_INDEX + 1; i < (uint32_t)nodes.size(); ++i)
+    {
+        std::string name_case(str_uppercase(std::string(String(nodes[i].name_offset, nodes[i].name_length))));
+
+        offsets[i] = (uint32_t)_pathStrings.size();
+        _pathStrings += name_case;
+        _pathStrings += name_case + ';' + std::to_string(nodes[i].version);
+    }
+
+    // first entry wins for duplicate names, same as sequential directory search
+    _paths.clear();
+    _paths.reserve(nodes.size() * 2);
+    for(uint32_t i = ROOT_INDEX + 1; i < (uint32_t)nodes.size(); ++i)
+    {
+        uint32_t end = i + 1 < (uint32_t)nodes.size() ? offsets[i + 1] : (uint32_t)_pathStrings.size();
+        uint32_t length = nodes[i].name_length;
+
+        _paths.emplace(PathKey{nodes[i].parent, std::string_view(_pathStrings.data() + offsets[i], length)}, i);
+        _paths.emplace(PathKey{nodes[i].parent, std::string_view(_pathStrings.data() + offsets[i] + length, end - offsets[i] - length)}, i);
+    }
 }
 
 
-bool ImageBrowser::Entry::IsDummy() const
+bool ImageBrowser::PathKey::operator==(const PathKey &other) const
 {
-    uint32_t offset = _directory_record.offset.lsb - _browser._trackOffset;
-    return offset + SectorSize() >= _browser._trackSize || offset >= _browser._trackSize;
+    return parent == other.parent && name == other.name;
 }
 
 
-uint32_t ImageBrowser::Entry::SectorSize() const
+size_t ImageBrowser::PathKeyHash::operator()(const PathKey &key) const
 {
-    return _directory_record.data_length.lsb / cdrom::FORM1_DATA_SIZE
-        + (_directory_record.data_length.lsb % cdrom::FORM1_DATA_SIZE ? 1 : 0);
+    size_t h = std::hash<std::string_view>()(key.name);
+    return h ^ (std::hash<uint32_t>()(key.parent) + 0x9E3779B9 + (h << 6) + (h >> 2));
 }
 
 
-time_t ImageBrowser::Entry::DateTime() const
+std::string_view ImageBrowser::String(uint32_t offset, uint32_t length) const
 {
-    return convert_time(_directory_record.recording_date_time);
+    return std::string_view(_strings.data() + offset, length);
 }
 
 
-std::vector<uint8_t> ImageBrowser::Entry::Read(bool form2, bool throw_on_error)
+uint32_t ImageBrowser::AddString(std::string_view str)
 {
-    std::vector<uint8_t> data;
+    uint32_t offset = (uint32_t)_strings.size();
+    _strings.append(str);
+
+    return offset;
+}
+
+
+void ImageBrowser::ThrowUnreadable()
+{
+    throw_line("unable to read directory record");
+}
 
-    uint32_t size = _directory_record.data_length.lsb;
-    data.reserve(size);
 
-    uint32_t offset = _directory_record.offset.lsb - _browser._trackOffset;
-    _browser._ifs.seekg(offset * sizeof(cdrom::Sector));
-    if(_browser._ifs.fail())
+std::vector<uint32_t> ImageBrowser::Files(bool &unreadable)
+{
+    auto &nodes = Nodes();
+
+    std::vector<uint32_t> files;
+    unreadable = false;
+    for(uint32_t i = ROOT_INDEX; i < (uint32_t)nodes.size(); ++i)
     {
-        _browser._ifs.clear();
-        if(throw_on_error)
-            throw_line("seek failure");
+        if(nodes[i].directory_record.file_flags & (uint8_t)iso9660::DirectoryRecord::FileFlags::DIRECTORY)
+        {
+            if(nodes[i].unreadable)
+            {
+                unreadable = true;
+                break;
+            }
+        }
+        else
+            files.push_back(i);
     }
-    else
+
+    return files;
+}
+
+
+std::string_view ImageBrowser::ParentPath(uint32_t index) const
+{
+    auto &parent = _nodes[_nodes[index].parent];
+    return String(parent.path_offset, parent.path_length);
+}
+
+
+bool ImageBrowser::RunParallel(uint32_t count, Delivery delivery, const std::function<void(uint32_t)> &work, const std::function<bool(uint32_t)> &done)
+{
+    static const uint32_t BATCH_SIZE = 16;
+
+    std::mutex mutex;
+    std::condition_variable completed_cv;
+    std::vector<uint32_t> completed;
+    std::exception_ptr exception;
+    std::atomic<bool> stop(false);
+
+    // one pool serves every traversal and directory prefetch of the browser
+    if(!_pool)
+        _pool = std::make_unique<ThreadPool>(_jobs);
+    auto &pool = *_pool;
+
+    for(uint32_t b = 0; b < count; b += BATCH_SIZE)
+        pool.Submit([&, b]()
+                    {
+                        for(uint32_t i = b; i < std::min(b + BATCH_SIZE, count) && !stop; ++i)
+                        {
+                            try
+                            {
+                                work(i);
+                            }
+                            catch(...)
+                            {
+                                {
+                                    std::lock_guard<std::mutex> lock(mutex);
+                                    if(!exception)
+                                        exception = std::current_exception();
+                                    stop = true;
+                                }
+                                completed_cv.notify_one();
+                                return;
+                            }
+
+                            {
+                                std::lock_guard<std::mutex> lock(mutex);
+                                completed.push_back(i);
+                            }
+                            completed_cv.notify_one();
+                        }
+                    });
+
+    bool interrupted = false;
+    try
     {
-        uint32_t sectors_count = SectorSize();
-        for(uint32_t s = 0; s < sectors_count; ++s)
+        std::vector<bool> ready(delivery == Delivery::ORDERED ? count : 0);
+        std::vector<uint32_t> batch;
+        for(uint32_t delivered = 0, next = 0; delivered < count && !interrupted;)
         {
-            cdrom::Sector sector;
-            _browser._ifs.read((char *)&sector, sizeof(sector));
-            if(_browser._ifs.fail())
             {
-                auto message(std::string("read failure [") + std::strerror(errno) + "]");
-                _browser._ifs.clear();
-                if(throw_on_error)
-                    throw_line(message);
+                std::unique_lock<std::mutex> lock(mutex);
+                completed_cv.wait(lock, [&]{ return !completed.empty() || exception; });
+                if(exception)
+                    break;
+                batch.swap(completed);
+            }
 
-                break;
+            for(auto i : batch)
+            {
+                if(delivery == Delivery::ORDERED)
+                    ready[i] = true;
+                else
+                {
+                    ++delivered;
+                    if(done(i))
+                    {
+                        interrupted = true;
+                        break;
+                    }
+                }
             }
+            batch.clear();
 
-            uint8_t *user_data;
+            for(; delivery == Delivery::ORDERED && !interrupted && next < count && ready[next]; ++next)
+            {
+                ++delivered;
+                interrupted = done(next);
+            }
+        }
+    }
+    catch(...)
+    {
+        stop = true;
+        pool.Wait();
+        throw;
+    }
+
+    stop = true;
+    pool.Wait();
+
+    if(exception)
+        std::rethrow_exception(exception);
+
+    return interrupted;
+}
+
+
+std::vector<uint8_t> ImageBrowser::ReadExtent(uint32_t lba, uint32_t size, bool form2, bool throw_on_error)
+{
+    std::vector<uint8_t> data;
+
+    data.reserve(size);
+
+    ReadExtent(lba, size, form2, throw_on_error, [&data](const uint8_t *chunk, uint32_t chunk_size)
+    {
+        data.insert(data.end(), chunk, chunk + chunk_size);
+        return false;
+    });
+
+    return data;
+}
+
+
+bool ImageBrowser::ReadExtent(uint32_t lba, uint32_t size, bool form2, bool throw_on_error, const ReadCallback &callback)
+{
+    uint32_t offset = lba - _trackOffset;
+    uint32_t sectors_count = size / cdrom::FORM1_DATA_SIZE + (size % cdrom::FORM1_DATA_SIZE ? 1 : 0);
+    _source->Advise(offset, sectors_count, SectorSource::Access::SEQUENTIAL);
+
+    // sectors are read in batches, mapped source doesn't use the buffer
+    std::unique_ptr<cdrom::Sector[]> buffer(new cdrom::Sector[std::min(sectors_count, READ_BATCH_SECTORS)]);
+    for(uint32_t s = 0; s < sectors_count;)
+    {
+        uint32_t count = std::min(sectors_count - s, READ_BATCH_SECTORS);
+        auto sectors = _source->Sectors(buffer.get(), offset + s, count);
+        if(!count)
+        {
+            if(throw_on_error)
+                throw_line(std::string("read failure [") + std::strerror(errno) + "]");
+
+            return false;
+        }
+
+        for(uint32_t i = 0; i < count; ++i, ++s)
+        {
+            // filter out sectors of unwanted form without looking at them
+            if(_sectorMap && offset + s < _sectorMap->Size())
+            {
+                uint8_t form = _sectorMap->FileForm(offset + s);
+                if(!form || (form == 2) != form2)
+                    continue;
+            }
+
+            auto sector = &sectors[i];
+
+            const uint8_t *user_data;
             uint32_t bytes_to_copy;
-            if(sector.header.mode == 1)
+            if(sector->header.mode == 1)
             {
                 if(form2)
                     continue;
 
-                user_data = sector.mode1.user_data;
+                user_data = sector->mode1.user_data;
                 bytes_to_copy = std::min(cdrom::FORM1_DATA_SIZE, size);
             }
-            else if(sector.header.mode == 2)
+            else if(sector->header.mode == 2)
             {
-                if(sector.mode2.xa.sub_header.submode & (uint8_t)cdrom::CDXAMode::FORM2)
+                if(sector->mode2.xa.sub_header.submode & (uint8_t)cdrom::CDXAMode::FORM2)
                 {
                     if(!form2)
                         continue;
 
-                    user_data = sector.mode2.xa.form2.user_data;
+                    user_data = sector->mode2.xa.form2.user_data;
                     bytes_to_copy = size < cdrom::FORM1_DATA_SIZE ? size : cdrom::FORM2_DATA_SIZE;
                 }
                 else
@@ -360,119 +889,272 @@ std::vector<uint8_t> ImageBrowser::Entry::Read(bool form2, bool throw_on_error)
                     if(form2)
                         continue;
 
-                    user_data = sector.mode2.xa.form1.user_data;
+                    user_data = sector->mode2.xa.form1.user_data;
                     bytes_to_copy = std::min(cdrom::FORM1_DATA_SIZE, size);
                 }
             }
             else
                 continue;
 
-            data.insert(data.end(), user_data, user_data + bytes_to_copy);
-
             size -= std::min(cdrom::FORM1_DATA_SIZE, size);
+
+            if(callback(user_data, bytes_to_copy))
+                return true;
         }
     }
 
-    return data;
+    return false;
 }
 
 
-bool ImageBrowser::Entry::IsInterleaved() const
+ImageBrowser::Entry::Entry(ImageBrowser &browser, uint32_t index)
+	: _browser(&browser)
+	, _index(index)
 {
-    bool interleaved = false;
+	;
+}
 
-    static const uint32_t SECTORS_TO_ANALYZE = 8 * 4;
 
-    uint32_t offset = _directory_record.offset.lsb - _browser._trackOffset;
-    _browser._ifs.seekg(offset * sizeof(cdrom::Sector));
-    if(_browser._ifs.fail())
-    {
-        _browser._ifs.clear();
-        throw_line("seek failure");
-    }
+const ImageBrowser::Node &ImageBrowser::Entry::GetNode() const
+{
+    return _browser->_nodes[_index];
+}
 
-    uint8_t file_form = 0;
 
-    uint32_t size = _directory_record.data_length.lsb;
-    uint32_t sectors_count = std::min(SectorSize(), SECTORS_TO_ANALYZE);
-    for(uint32_t s = 0; s < sectors_count; ++s)
+const iso9660::DirectoryRecord &ImageBrowser::Entry::DirectoryRecord() const
+{
+    return GetNode().directory_record;
+}
+
+
+bool ImageBrowser::Entry::IsDirectory() const
+{
+	return DirectoryRecord().file_flags & (uint8_t)iso9660::DirectoryRecord::FileFlags::DIRECTORY;
+}
+
+
+std::vector<ImageBrowser::Entry> ImageBrowser::Entry::Entries() const
+{
+	std::vector<Entry> entries;
+
+	if(IsDirectory())
+	{
+		auto &node = GetNode();
+		if(node.unreadable)
+			ThrowUnreadable();
+
+		entries.reserve(node.children_count);
+		for(uint32_t i = 0; i < node.children_count; ++i)
+			entries.push_back(Entry(*_browser, node.children_offset + i));
+	}
+
+	return entries;
+}
+
+
+std::optional<ImageBrowser::Entry> ImageBrowser::Entry::SubEntry(const std::filesystem::path &path) const
+{
+	std::optional<Entry> entry;
+
+    auto &paths = _browser->Paths();
+
+    std::filesystem::path path_case(str_uppercase(path.generic_string()));
+
+    uint32_t index = _index;
+    for(auto const &p : path_case)
     {
-        cdrom::Sector sector;
-        _browser._ifs.read((char *)&sector, sizeof(sector));
-        if(_browser._ifs.fail())
+        auto &node = _browser->_nodes[index];
+        if(node.unreadable)
+            ThrowUnreadable();
+
+        std::string name(p.string());
+        auto it = paths.find(PathKey{index, name});
+        if(it == paths.end())
         {
-            auto message(std::string("read failure (") + std::strerror(errno) + ")");
-            _browser._ifs.clear();
-            throw_line(message);
+            entry.reset();
+            break;
         }
 
-        uint8_t file_form_next = 0;
-        if(sector.header.mode == 1)
-            file_form_next = 1;
-        else if(sector.header.mode == 2)
-            file_form_next = sector.mode2.xa.sub_header.submode & (uint8_t)cdrom::CDXAMode::FORM2 ? 2 : 1;
+        index = it->second;
+        entry = Entry(*_browser, index);
+    }
+
+	return entry;
+}
+
+
+std::string_view ImageBrowser::Entry::Name() const
+{
+	auto &node = GetNode();
+	return _browser->String(node.name_offset, node.name_length);
+}
 
-        if(file_form)
+
+uint32_t ImageBrowser::Entry::Version() const
+{
+	return GetNode().version;
+}
+
+
+bool ImageBrowser::Entry::IsDummy() const
+{
+    uint32_t offset = DirectoryRecord().offset.lsb - _browser->_trackOffset;
+    return offset + SectorSize() >= _browser->_trackSize || offset >= _browser->_trackSize;
+}
+
+
+uint32_t ImageBrowser::Entry::SectorSize() const
+{
+    return DirectoryRecord().data_length.lsb / cdrom::FORM1_DATA_SIZE
+        + (DirectoryRecord().data_length.lsb % cdrom::FORM1_DATA_SIZE ? 1 : 0);
+}
+
+
+time_t ImageBrowser::Entry::DateTime() const
+{
+    return convert_time(DirectoryRecord().recording_date_time);
+}
+
+
+std::vector<uint8_t> ImageBrowser::Entry::Read(bool form2, bool throw_on_error) const
+{
+    return _browser->ReadExtent(DirectoryRecord().offset.lsb, DirectoryRecord().data_length.lsb, form2, throw_on_error);
+}
+
+
+bool ImageBrowser::Entry::Read(const ReadCallback &callback, bool form2, bool throw_on_error) const
+{
+    return _browser->ReadExtent(DirectoryRecord().offset.lsb, DirectoryRecord().data_length.lsb, form2, throw_on_error, callback);
+}
+
+
+std::vector<uint8_t> ImageBrowser::Entry::ReadRange(uint32_t data_offset, uint32_t size, bool form2, bool throw_on_error) const
+{
+    std::vector<uint8_t> data;
+
+    uint32_t data_length = DirectoryRecord().data_length.lsb;
+
+    // every data sector but the last one is full, that makes sector lookup a division,
+    // same accounting as in ReadExtent, data length is counted in form 1 sectors
+    uint32_t sector_data_size = form2 ? cdrom::FORM2_DATA_SIZE : cdrom::FORM1_DATA_SIZE;
+    uint32_t first = data_offset / sector_data_size;
+    uint32_t data_sectors = data_length / cdrom::FORM1_DATA_SIZE + (data_length % cdrom::FORM1_DATA_SIZE ? 1 : 0);
+    if(!size || first >= data_sectors)
+        return data;
+    uint32_t count = (uint32_t)std::min<uint64_t>(((uint64_t)data_offset + size - 1) / sector_data_size + 1, data_sectors) - first;
+
+    data.reserve(std::min(size, data_length));
+
+    std::unique_ptr<cdrom::Sector[]> buffer;
+    uint32_t k_offset = data_offset % sector_data_size;
+    for(auto const &run : _browser->SectorRuns(_index, form2, first, count))
+    {
+        for(uint32_t r = 0; r < run.count && size;)
         {
-            if(file_form != file_form_next)
+            if(!buffer)
+                buffer.reset(new cdrom::Sector[READ_BATCH_SECTORS]);
+
+            uint32_t n = std::min(run.count - r, READ_BATCH_SECTORS);
+            auto sectors = _browser->_source->Sectors(buffer.get(), run.offset + r, n);
+            if(!n)
             {
-                interleaved = true;
-                break;
+                if(throw_on_error)
+                    throw_line(std::string("read failure [") + std::strerror(errno) + "]");
+
+                return data;
+            }
+
+            for(uint32_t i = 0; i < n && size; ++i, k_offset = 0)
+            {
+                uint32_t k = run.data_sector + r + i;
+                uint32_t remaining = data_length - k * cdrom::FORM1_DATA_SIZE;
+                uint32_t sector_size = form2 ? (remaining < cdrom::FORM1_DATA_SIZE ? remaining : cdrom::FORM2_DATA_SIZE) : std::min(cdrom::FORM1_DATA_SIZE, remaining);
+                if(k_offset >= sector_size)
+                    return data;
+
+                auto sector = &sectors[i];
+                const uint8_t *user_data;
+                if(form2)
+                    user_data = sector->mode2.xa.form2.user_data;
+                else
+                    user_data = sector->header.mode == 1 ? sector->mode1.user_data : sector->mode2.xa.form1.user_data;
+
+                uint32_t bytes_to_copy = std::min(sector_size - k_offset, size);
+                data.insert(data.end(), user_data + k_offset, user_data + k_offset + bytes_to_copy);
+                size -= bytes_to_copy;
             }
+            r += n;
         }
-        else
-            file_form = file_form_next;
     }
 
-    return interleaved;
+    return data;
 }
 
 
-/*
-// this is sequential as interleaved sectors have to be taken into account
-std::vector<uint8_t> ImageBrowser::Entry::Read(uint32_t data_offset, uint32_t size)
+bool ImageBrowser::Entry::IsInterleaved() const
 {
-std::vector<uint8_t> data;
-data.reserve(size);
+    bool interleaved = false;
 
-uint32_t sectors_count = _directory_record.data_length.lsb / cdrom::FORM1_DATA_SIZE + (_directory_record.data_length.lsb % cdrom::FORM1_DATA_SIZE ? 1 : 0);
+    static const uint32_t SECTORS_TO_ANALYZE = 8 * 4;
 
-uint32_t sector_offset = data_offset / cdrom::FORM1_DATA_SIZE;
-uint32_t offset = data_offset % cdrom::FORM1_DATA_SIZE;
+    uint32_t offset = DirectoryRecord().offset.lsb - _browser->_trackOffset;
 
-for(uint32_t s = 0, ds = 0; s < sectors_count; ++s)
-{
-cdrom::Sector sector;
-_ifs.read((char *)&sector, sizeof(sector));
+    uint8_t file_form = 0;
 
-// skip interleaved audio sectors
-if(sector.mode2.xa.sub_header.submode & (uint8_t)cdrom::CDXAMode::AUDIO)
-continue;
+    uint32_t sectors_count = std::min(SectorSize(), SECTORS_TO_ANALYZE);
 
-// PSX CDXA Mode2Form2 is used only for audio data
-if(sector.mode2.xa.sub_header.submode & (uint8_t)cdrom::CDXAMode::FORM2)
-throw_line("Mode2Form2 non audio sector detected");
+    // O(1) lookup if sector map is available
+    auto &sector_map = _browser->_sectorMap;
+    if(sector_map && offset < sector_map->Size() && sectors_count <= sector_map->Size() - offset)
+    {
+        for(uint32_t s = 0; s < sectors_count; ++s)
+        {
+            uint8_t file_form_next = sector_map->FileForm(offset + s);
+            if(file_form && file_form != file_form_next)
+                return true;
+            if(!file_form)
+                file_form = file_form_next;
+        }
 
-if(ds >= sector_offset)
-{
-uint32_t bytes_to_copy = std::min(cdrom::FORM1_DATA_SIZE - offset, size);
+        return false;
+    }
 
-auto data_start = sector.mode2.xa.form1.user_data + offset;
-data.insert(data.end(), data_start, data_start + bytes_to_copy);
-offset = 0;
-size -= bytes_to_copy;
+    std::unique_ptr<cdrom::Sector[]> buffer(new cdrom::Sector[std::min(sectors_count, READ_BATCH_SECTORS)]);
+    for(uint32_t s = 0; s < sectors_count && !interleaved;)
+    {
+        uint32_t count = std::min(sectors_count - s, READ_BATCH_SECTORS);
+        auto sectors = _browser->_source->Sectors(buffer.get(), offset + s, count);
+        if(!count)
+            throw_line(std::string("read failure (") + std::strerror(errno) + ")");
 
-if(!size)
-break;
-}
+        for(uint32_t i = 0; i < count; ++i, ++s)
+        {
+            auto sector = &sectors[i];
 
-++ds;
-}
+            uint8_t file_form_next = 0;
+            if(sector->header.mode == 1)
+                file_form_next = 1;
+            else if(sector->header.mode == 2)
+                file_form_next = sector->mode2.xa.sub_header.submode & (uint8_t)cdrom::CDXAMode::FORM2 ? 2 : 1;
 
-return data;
+            if(file_form)
+            {
+                if(file_form != file_form_next)
+                {
+                    interleaved = true;
+                    break;
+                }
+            }
+            else
+                file_form = file_form_next;
+        }
+    }
+
+    return interleaved;
 }
 
 
+/*
 std::vector<uint8_t> ImageBrowser::Entry::Read(std::set<uint8_t> *xa_channels)
 {
     std::vector<uint8_t> data;
@@ -4,92 +4,273 @@
 
 #include <ctime>
 #include <filesystem>
-#include <fstream>
-#include <queue>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <optional>
 #include <string>
+#include <string_view>
+#include <type_traits>
+#include <unordered_map>
+#include <vector>
 #include "cdrom.hh"
+#include "hash_cache.hh"
 #include "iso9660.hh"
+#include "sector_map.hh"
+#include "sector_source.hh"
 
 
 
 namespace redump_info
 {
 
+class ThreadPool;
+
 class ImageBrowser
 {
+	struct Node;
+
 public:
+	// receives file user data sector by sector, returning true stops the read
+	typedef std::function<bool(const uint8_t *data, uint32_t size)> ReadCallback;
+
+	// lightweight handle to the directory index node, valid as long as browser is alive
 	class Entry
 	{
 		friend class ImageBrowser;
 
 	public:
 		bool IsDirectory() const;
-		std::list<std::shared_ptr<Entry>> Entries();
-		std::shared_ptr<Entry> SubEntry(const std::filesystem::path &path);
-		const std::string &Name() const;
+		std::vector<Entry> Entries() const;
+		std::optional<Entry> SubEntry(const std::filesystem::path &path) const;
+		std::string_view Name() const;
 		uint32_t Version() const;
 		time_t DateTime() const;
-		std::vector<uint8_t> Read(bool form2 = false, bool throw_on_error = false);
+		std::vector<uint8_t> Read(bool form2 = false, bool throw_on_error = false) const;
+		// streams file data without holding it in memory, true if read was stopped by callback
+		bool Read(const ReadCallback &callback, bool form2 = false, bool throw_on_error = false) const;
+		// bytes [data_offset, data_offset + size) of Read(form2) data, only sectors holding them are read
+		std::vector<uint8_t> ReadRange(uint32_t data_offset, uint32_t size, bool form2 = false, bool throw_on_error = false) const;
 		bool IsDummy() const;
 		bool IsInterleaved() const;
 		//DEBUG
 //		std::set<uint8_t> ReadMode2Test();
-//		std::vector<uint8_t> Read(uint32_t data_offset, uint32_t size);
 //		std::vector<uint8_t> Read(std::set<uint8_t> *xa_channels = NULL);
 //		std::vector<uint8_t> ReadXA(uint8_t channel);
 
-		iso9660::DirectoryRecord _directory_record;
-		ImageBrowser &_browser;
-		std::string _name;
-		uint32_t _version;
+		const iso9660::DirectoryRecord &DirectoryRecord() const;
+		uint32_t SectorSize() const;
 
-		Entry(ImageBrowser &browser, const std::string &name, uint32_t version, const iso9660::DirectoryRecord &directory_record);
+	private:
+		ImageBrowser *_browser;
+		uint32_t _index;
 
-		uint32_t SectorSize() const;
+		Entry(ImageBrowser &browser, uint32_t index);
+
+		const Node &GetNode() const;
+	};
+
+	enum class Delivery
+	{
+		ORDERED,
+		UNORDERED
 	};
 
 	static bool IsDataTrack(const std::filesystem::path &track);
 
-	ImageBrowser(const std::filesystem::path &data_track);
+	// sector map is optional, if available sector type queries don't touch the track data,
+	// jobs is the number of threads used for directory reads and parallel traversal, 0 for all cores,
+	// if index cache directory is specified, parsed directory tree is reused for unchanged track file,
+	// mapped track access is opt-in, see SectorSource::Open()
+	ImageBrowser(const std::filesystem::path &data_track, std::shared_ptr<const SectorMap> sector_map = nullptr, uint32_t jobs = 1,
+	             const std::filesystem::path &index_cache = std::filesystem::path(), bool mapped = false);
+	~ImageBrowser();
 
-	std::shared_ptr<Entry> RootDirectory();
+	Entry RootDirectory();
 
     const iso9660::VolumeDescriptor &GetPVD() const;
 
+	// breadth first traversal of all files, path is the path of the parent directory
 	template<typename F>
 	bool Iterate(F f)
 	{
-		bool interrupted = false;
+		auto &nodes = Nodes();
 
-		std::queue<std::pair<std::string, std::shared_ptr<Entry>>> q;
-		q.push(std::pair<std::string, std::shared_ptr<Entry>>(std::string(""), RootDirectory()));
-
-		while(!q.empty())
+		std::string path;
+		uint32_t path_parent = ROOT_INDEX;
+		for(uint32_t i = ROOT_INDEX; i < (uint32_t)nodes.size(); ++i)
 		{
-			auto p = q.front();
-			q.pop();
+			auto &n = nodes[i];
+
+			if(n.directory_record.file_flags & (uint8_t)iso9660::DirectoryRecord::FileFlags::DIRECTORY)
+			{
+				if(n.unreadable)
+					ThrowUnreadable();
+				continue;
+			}
 
-			if(p.second->IsDirectory())
-				for(auto &dd : p.second->Entries())
-					q.push(std::pair<std::string, std::shared_ptr<Entry>>(dd->IsDirectory() ? (p.first.empty() ? "" : p.first + "/") + dd->Name() : p.first, dd));
-			else
+			if(n.parent != path_parent)
 			{
-				if(f(p.first, p.second))
-				{
-					interrupted = true;
-					break;
-				}
+				path_parent = n.parent;
+				path.assign(String(nodes[path_parent].path_offset, nodes[path_parent].path_length));
 			}
+
+			if(f(path, Entry(*this, i)))
+				return true;
 		}
 
+		return false;
+	}
+
+	// parallel traversal of all files, f(path, entry) runs concurrently on worker threads and may only use
+	// entry read methods, it's result is passed to d(path, entry, result) on the calling thread
+	// either in traversal order or as soon as it's available, traversal is interrupted if d returns true
+	template<typename F, typename D>
+	bool Iterate(Delivery delivery, F f, D d)
+	{
+		if(_jobs == 1)
+			return Iterate([&](const std::string &path, Entry entry) { return d(path, entry, f(path, entry)); });
+
+		bool unreadable;
+		auto files = Files(unreadable);
+
+		std::vector<std::optional<std::invoke_result_t<F, const std::string &, Entry>>> results(files.size());
+
+		std::string path;
+		bool interrupted = RunParallel((uint32_t)files.size(), delivery,
+			[&](uint32_t i)
+			{
+				results[i].emplace(f(std::string(ParentPath(files[i])), Entry(*this, files[i])));
+			},
+			[&](uint32_t i)
+			{
+				path.assign(ParentPath(files[i]));
+				bool exit = d(path, Entry(*this, files[i]), std::move(*results[i]));
+				results[i].reset();
+				return exit;
+			});
+
+		if(!interrupted && unreadable)
+			ThrowUnreadable();
+
 		return interrupted;
 	}
 
 private:
-	std::ifstream _ifs;
+	static const uint32_t ROOT_INDEX = 0;
+	static constexpr uint32_t READ_BATCH_SECTORS = 32;
+
+	// flat directory tree in breadth first order, children of a directory are contiguous
+	struct Node
+	{
+		iso9660::DirectoryRecord directory_record;
+		uint32_t version;
+		uint32_t parent;
+		// offsets to the strings arena
+		uint32_t name_offset;
+		uint32_t name_length;
+		// directories only
+		uint32_t path_offset;
+		uint32_t path_length;
+		uint32_t children_offset;
+		uint32_t children_count;
+		bool unreadable;
+	};
+
+	// child lookup key, name is uppercased and either plain or with version suffix
+	struct PathKey
+	{
+		uint32_t parent;
+		std::string_view name;
+
+		bool operator==(const PathKey &other) const;
+	};
+
+	struct PathKeyHash
+	{
+		size_t operator()(const PathKey &key) const;
+	};
+
+	// consecutive file sectors holding data of the requested form
+	struct SectorRun
+	{
+		// number of file data sectors preceding the run
+		uint32_t data_sector;
+		// track relative offset of the first sector
+		uint32_t offset;
+		uint32_t count;
+	};
+
+	std::unique_ptr<SectorSource> _source;
+	std::shared_ptr<const SectorMap> _sectorMap;
+	uint32_t _jobs;
+	std::unique_ptr<ThreadPool> _pool;
 	iso9660::VolumeDescriptor _pvd;
 	uint32_t _trackOffset;
 	uint32_t _trackSize;
+
+	std::vector<Node> _nodes;
+	std::string _strings;
+	bool _indexed;
+
+	std::filesystem::path _indexCachePath;
+	HashCache::Key _trackKey;
+
+	std::unordered_map<PathKey, uint32_t, PathKeyHash> _paths;
+	std::string _pathStrings;
+	bool _pathsIndexed;
+
+	// data sectors of a file found so far, extended on demand
+	struct SectorIndex
+	{
+		std::vector<SectorRun> runs;
+		// file sectors classified so far
+		uint32_t sectors_scanned;
+		uint32_t data_sectors;
+		// all sectors classified or read failure
+		bool complete;
+		// held while the index is extended, readers of other files aren't blocked
+		std::mutex mutex;
+	};
+
+	// map nodes are stable, only lookup and insertion are done under the map mutex
+	std::map<std::pair<uint32_t, bool>, SectorIndex> _sectorIndexes;
+	std::mutex _sectorIndexesMutex;
+
+	static bool FindPVD(iso9660::VolumeDescriptor &pvd, SectorSource &source);
+
+	// directory tree is parsed on first use
+	const std::vector<Node> &Nodes();
+	void BuildIndex();
+	// directory data is taken from prefetched extents if provided, false if they don't match directory records
+	bool BuildIndex(const std::map<uint32_t, std::vector<uint8_t>> *directories);
+	// reads all directory extents listed in the path table in ascending LBA order
+	bool ReadPathTableDirectories(std::map<uint32_t, std::vector<uint8_t>> &directories);
+	// false if cached index is missing or doesn't match the track
+	bool LoadIndex();
+	// best effort, false if index couldn't be written
+	bool StoreIndex() const;
+	// loaded nodes only reference nodes and strings that exist
+	bool IndexValid() const;
+	std::vector<uint8_t> ReadExtent(uint32_t lba, uint32_t size, bool form2, bool throw_on_error);
+	bool ReadExtent(uint32_t lba, uint32_t size, bool form2, bool throw_on_error, const ReadCallback &callback);
+	// case insensitive path lookup is built on first use
+	const std::unordered_map<PathKey, uint32_t, PathKeyHash> &Paths();
+	void BuildPaths();
+	std::string_view String(uint32_t offset, uint32_t length) const;
+	uint32_t AddString(std::string_view str);
+	static void ThrowUnreadable();
+	// runs of file data sectors [first, first + count), index is extended only as far as needed
+	std::vector<SectorRun> SectorRuns(uint32_t index, bool form2, uint32_t first, uint32_t count);
+
+	// file nodes in traversal order up to the first unreadable directory
+	std::vector<uint32_t> Files(bool &unreadable);
+	std::string_view ParentPath(uint32_t index) const;
+	// runs work for every item on the browser thread pool and calls done on the calling thread
+	// either in item order or in completion order, returns true if done interrupted processing,
+	// not reentrant, work must not start another parallel traversal
+	bool RunParallel(uint32_t count, Delivery delivery, const std::function<void(uint32_t)> &work, const std::function<bool(uint32_t)> &done);
 };
 
 }
@@ -1,12 +1,20 @@
+#include <algorithm>
 #include <cstddef>
+#include <cstring>
 #include <ctime>
 #include <filesystem>
+#include <fstream>
 #include <iostream>
+#include <memory>
 #include <regex>
 #include <sstream>
+#include <vector>
 #include "common.hh"
+#include "header_check.hh"
 #include "image_browser.hh"
 #include "psx.hh"
+#include "sector_source.hh"
+#include "sector_scanner.hh"
 #include "strings.hh"
 #include "info.hh"
 
@@ -44,34 +52,24 @@ bool mode2form2_edc_fast(const std::filesystem::path &f)
 {
 	bool edc = false;
 
-	ifstream ifs(f, ifstream::binary);
-	if(ifs.fail())
-		throw_line("unable to open file (" + std::strerror(errno) + ")");
-
-	// easier to iterate this way
-	uint64_t sectors_count = filesystem::file_size(f);
-	for(uint64_t i = 0; i < sectors_count; ++i)
+	auto source = SectorSource::Open(f);
+	SectorScanner scanner(*source);
+	std::vector<SectorScanner::Header> headers;
+	for(bool found = false; !found && scanner.Next(headers);)
 	{
-		uint8_t mode;
-		ifs.seekg(i * sizeof(cdrom::Sector) + offsetof(cdrom::Sector, header.mode));
-		ifs.read((char *)&mode, sizeof(mode));
-
-		// can we have mixed mode 1 mode 2 sectors in one track?
-		if(mode == 1)
-			break;
-
-		if(mode == 2)
+		for(auto const &h : headers)
 		{
-			uint8_t submode;
-			ifs.seekg(i * sizeof(cdrom::Sector) + offsetof(cdrom::Sector, mode2.xa.sub_header.submode));
-			ifs.read((char *)&submode, sizeof(submode));
-			if(submode & (uint8_t)cdrom::CDXAMode::FORM2)
+			// can we have mixed mode 1 mode 2 sectors in one track?
+			if(h.mode == 1)
 			{
-				uint32_t sector_edc;
-				ifs.seekg(i * sizeof(cdrom::Sector) + offsetof(cdrom::Sector, mode2.xa.form2.edc));
-				ifs.read((char *)&sector_edc, sizeof(sector_edc));
+				found = true;
+				break;
+			}
 
-				edc = sector_edc;
+			if(h.mode == 2 && h.submode & (uint8_t)cdrom::CDXAMode::FORM2)
+			{
+				edc = h.form2_edc;
+				found = true;
 				break;
 			}
 		}
@@ -81,42 +79,124 @@ bool mode2form2_edc_fast(const std::filesystem::path &f)
 }
 
 
-void info(const Options &o, const std::filesystem::path &f, void *)
+std::vector<string> header_check(const std::filesystem::path &f, bool mapped)
+{
+	auto source = SectorSource::Open(f, mapped);
+	uint32_t sectors_count = source->SectorsCount();
+	source->Advise(0, sectors_count, SectorSource::Access::SEQUENTIAL);
+
+	// whole track is checked, sectors are read in large batches
+	const uint32_t batch_sectors = 1024;
+	std::unique_ptr<cdrom::Sector[]> buffer(new cdrom::Sector[std::min(sectors_count, batch_sectors)]);
+
+	HeaderCheck check;
+	for(uint32_t i = 0; i < sectors_count;)
+	{
+		uint32_t count = std::min(sectors_count - i, batch_sectors);
+		auto sectors = source->Sectors(buffer.get(), i, count);
+		if(!count)
+			throw_line("read failure");
+		check.Update(sectors, count);
+		i += count;
+	}
+	if(!check.SyncFound())
+		throw_line("no data sectors found");
+
+	std::vector<string> errors;
+	for(auto const &r : check.Ranges())
+	{
+		std::stringstream ss;
+		// expected LBA drifts from the file position after a confirmed jump, report both
+		ss << "LBA: ";
+		if(r.count > 1)
+			ss << "[" << r.lba << " .. " << r.lba + (int32_t)r.count - 1 << "], sectors: [" << r.index << " .. " << r.index + r.count - 1 << "]";
+		else
+			ss << r.lba << ", sector: " << r.index;
+
+		switch(r.error)
+		{
+		case HeaderCheck::Error::MISSING:
+			ss << ", missing sync";
+			break;
+		case HeaderCheck::Error::REPEAT:
+			ss << ", repeated address (LBA: " << r.address << ")";
+			break;
+		case HeaderCheck::Error::JUMP:
+			ss << ", address jump (LBA: " << r.address << ")";
+			break;
+		}
+
+		errors.push_back(ss.str());
+	}
+
+	return errors;
+}
+
+
+void info(const Options &o, const std::filesystem::path &f, std::ostream &os, void *)
 {
 	try
 	{
-		ImageBrowser browser(f);
+		// sector header check works on dumps where filesystem can't be found, report them instead of skipping
+		std::vector<string> header_errors;
+		if(o.header_check)
+			header_errors = header_check(f, o.mmap);
+
+		std::unique_ptr<ImageBrowser> browser;
+		try
+		{
+			browser = std::make_unique<ImageBrowser>(f, nullptr, o.fs_jobs, o.index_cache_path, o.mmap);
+		}
+		catch(const std::exception &)
+		{
+			if(header_errors.empty())
+				throw;
+		}
 
-		cout << f.generic_string();
+		os << f.generic_string();
 		if(o.batch)
-			cout << ",";
+			os << ",";
 		else
-			cout << ": " << endl;
+			os << ": " << endl;
 
 		if(o.start_msf)
 		{
 			if(!o.batch)
-				cout << "\tStart MSF: ";
-			cout << start_msf(f) << endl;
+				os << "\tStart MSF: ";
+			os << start_msf(f) << endl;
 		}
 
 		if(o.sector_size)
 		{
 			if(!o.batch)
-				cout << "\tSectors count: ";
-			cout << filesystem::file_size(f) / sizeof(cdrom::Sector) << endl;
+				os << "\tSectors count: ";
+			os << filesystem::file_size(f) / sizeof(cdrom::Sector) << endl;
 		}
 
 		if(o.edc)
 		{
 			if(!o.batch)
-				cout << "\tMode2Form2 EDC: ";
-			cout << (mode2form2_edc_fast(f) ? "Yes" : "No") << endl;
+				os << "\tMode2Form2 EDC: ";
+			os << (mode2form2_edc_fast(f) ? "Yes" : "No") << endl;
+		}
+
+		if(o.header_check)
+		{
+			if(!o.batch)
+				os << "\tSector headers: ";
+			if(header_errors.empty())
+				os << "OK" << endl;
+			else
+			{
+				os << header_errors.size() << " errors" << endl;
+				for(auto const &e : header_errors)
+					os << "\t\t" << e << endl;
+			}
 		}
 
-		if(o.pvd_time)
+		if(o.pvd_time && browser)
 		{
-			auto &pvd = browser.GetPVD();
+			auto &pvd = browser->GetPVD();
 
 			time_t time_newest = iso9660::convert_time(pvd.primary.volume_creation_date_time);
 			/*
@@ -127,15 +207,16 @@ void info(const Options &o, const std::filesystem::path &f, void *)
 			cout << "[PVD]: " << buffer << endl;
 			}
 			*/
-			browser.Iterate([&](const std::string &path, std::shared_ptr<ImageBrowser::Entry> d)
+			// no I/O per entry, sequential walk is cheaper than the parallel one
+			browser->Iterate([&](const std::string &, ImageBrowser::Entry d)
 							{
 								bool exit = false;
 
-								time_t file_time = d->DateTime();
+								time_t file_time = d.DateTime();
 								/*
 								// DEBUG
 								{
-								auto fp((path.empty() ? "" : path + "/") + d->Name());
+								auto fp((path.empty() ? "" : path + "/") + d.Name());
 
 								char buffer[32];
 								strftime(buffer, 32, "%Y-%m-%d", localtime(&file_time));
@@ -151,23 +232,24 @@ void info(const Options &o, const std::filesystem::path &f, void *)
 			{
 				char buffer[32];
 				//				strftime(buffer, 32, "%Y-%m-%d %H:%M:%S", localtime(&time_newest));
-				strftime(buffer, 32, "%Y-%m-%d", localtime(&time_newest));
-				cout << buffer << endl;
+				auto tm = local_time(time_newest);
+				strftime(buffer, 32, "%Y-%m-%d", &tm);
+				os << buffer << endl;
 			}
 
 			//			cout << "";
 		}
 
-		if(o.file_offsets)
+		if(o.file_offsets && browser)
 		{
-			browser.Iterate([&](const std::string &path, std::shared_ptr<ImageBrowser::Entry> d)
+			browser->Iterate([&](const std::string &path, ImageBrowser::Entry d)
 							{
 								bool exit = false;
 
-								uint32_t sector_offset = d->_directory_record.offset.lsb;
-								uint32_t sector_size = d->SectorSize();
+								uint32_t sector_offset = d.DirectoryRecord().offset.lsb;
+								uint32_t sector_size = d.SectorSize();
 
-								std::cout << path + "/" + d->Name()
+								os << path << "/" << d.Name()
 									<< ", sector offset: " << sector_offset
 									<< ", sector size: " << sector_size
 									<< " [0x" << std::hex << std::setfill('0') << sector_offset * sizeof(cdrom::Sector) << std::setfill(' ') << std::dec
@@ -178,22 +260,22 @@ void info(const Options &o, const std::filesystem::path &f, void *)
 							});
 		}
 
-		if(o.launcher)
+		if(o.launcher && browser)
 		{
-			string launcher = psx::extract_exe_path(browser);
+			string launcher = psx::extract_exe_path(*browser);
 
 			if(!o.batch)
-				cout << "\tLauncher: ";
-			cout << (launcher.empty() ? "<unavailable>" : launcher) << endl;
+				os << "\tLauncher: ";
+			os << (launcher.empty() ? "<unavailable>" : launcher) << endl;
 		}
 
-		if(o.serial)
+		if(o.serial && browser)
 		{
-			string serial = psx::extract_serial(browser);
+			string serial = psx::extract_serial(*browser);
 
 			if(!o.batch)
-				cout << "\tSerial: ";
-			cout << (serial.empty() ? "<unavailable>" : serial) << endl;
+				os << "\tSerial: ";
+			os << (serial.empty() ? "<unavailable>" : serial) << endl;
 		}
 
 		if(o.system_area)
@@ -201,23 +283,23 @@ void info(const Options &o, const std::filesystem::path &f, void *)
 			//TODO
 		}
 
-		if(o.antimod)
+		if(o.antimod && browser)
 		{
-			auto entries = psx::detect_anti_modchip_string(browser);
+			auto entries = psx::detect_anti_modchip_string(*browser);
 			if(!entries.empty())
 			{
 				if(!o.batch)
-					cout << "\tAnti-Modchip: " << endl;
+					os << "\tAnti-Modchip: " << endl;
 
 				for(auto const &e : entries)
-					cout << "\t\t" << e << endl;
+					os << "\t\t" << e << endl;
 			}
 		}
 	}
 	catch(const std::exception &e)
 	{
 		if(o.verbose)
-			cout << f.generic_string() << ": skipped {" << e.what() << "}" << endl;
+			os << f.generic_string() << ": skipped {" << e.what() << "}" << endl;
 	}
 }
 
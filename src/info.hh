@@ -3,6 +3,7 @@
 
 
 #include <filesystem>
+#include <ostream>
 #include "options.hh"
 
 
@@ -10,6 +11,6 @@
 namespace redump_info
 {
 
-void info(const Options &o, const std::filesystem::path &f, void *data);
+void info(const Options &o, const std::filesystem::path &f, std::ostream &os, void *data);
 
 }
@@ -1,14 +1,21 @@
+#include <algorithm>
 #include <cstdint>
 #include <filesystem>
+#include <functional>
 #include <iostream>
+#include <mutex>
+#include <sstream>
 #include <string>
 #include <list>
+#include <vector>
 #include "common.hh"
 #include "dat.hh"
+#include "hash_cache.hh"
 #include "info.hh"
 #include "options.hh"
 #include "strings.hh"
 #include "submission.hh"
+#include "thread_pool.hh"
 
 
 
@@ -17,7 +24,10 @@ using namespace redump_info;
 
 
 
-void recursive_process(void (*callback)(const Options &, const std::filesystem::path &, void *), void *callback_data, const Options &options, const std::string &extension)
+typedef void (*ProcessCallback)(const Options &, const std::filesystem::path &, std::ostream &, void *);
+
+
+void traverse_files(const std::function<void(const std::filesystem::path &)> &visitor, const Options &options, const std::string &extension)
 {
     for(auto const &p : options.positional)
     {
@@ -27,7 +37,7 @@ void recursive_process(void (*callback)(const Options &, const std::filesystem::
         // one file
         if(filesystem::is_regular_file(p))
         {
-            callback(options, p, callback_data);
+            visitor(p);
         }
         // recurse directory
         else if(filesystem::is_directory(p))
@@ -45,7 +55,7 @@ void recursive_process(void (*callback)(const Options &, const std::filesystem::
                     if(!extension.empty() && str_lowercase(it.path().extension().generic_string()) != extension)
                         continue;
 
-                    callback(options, it.path(), callback_data);
+                    visitor(it.path());
                 }
             }
             else
@@ -60,7 +70,7 @@ void recursive_process(void (*callback)(const Options &, const std::filesystem::
                     if(!extension.empty() && str_lowercase(it.path().extension().generic_string()) != extension)
                         continue;
 
-                    callback(options, it.path(), callback_data);
+                    visitor(it.path());
                 }
             }
         }
@@ -70,6 +80,82 @@ void recursive_process(void (*callback)(const Options &, const std::filesystem::
 }
 
 
+// amount of data to be read, for CUE it's a sum of all track sizes
+uint64_t process_cost(const std::filesystem::path &p)
+{
+    uint64_t cost = 0;
+
+    std::error_code ec;
+    if(str_lowercase(p.extension().generic_string()) == ".cue")
+    {
+        try
+        {
+            for(auto const &f : cue_extract_files(p))
+            {
+                auto size = filesystem::file_size(p.parent_path() / f, ec);
+                if(!ec)
+                    cost += size;
+            }
+        }
+        catch(const exception &)
+        {
+            ;
+        }
+    }
+    else
+    {
+        auto size = filesystem::file_size(p, ec);
+        if(!ec)
+            cost = size;
+    }
+
+    return cost;
+}
+
+
+void recursive_process(ProcessCallback callback, void *callback_data, const Options &options, const std::string &extension)
+{
+    // serial, output goes straight to console
+    if(options.jobs == 1)
+    {
+        traverse_files([&](const filesystem::path &p)
+                       {
+                           callback(options, p, cout, callback_data);
+                       }, options, extension);
+    }
+    // parallel, largest first so that the longest job doesn't start last,
+    // output of every file is buffered and printed at once when it's done
+    else
+    {
+        vector<pair<uint64_t, filesystem::path>> files;
+        traverse_files([&](const filesystem::path &p)
+                       {
+                           files.emplace_back(process_cost(p), p);
+                       }, options, extension);
+        stable_sort(files.begin(), files.end(), [](const pair<uint64_t, filesystem::path> &a, const pair<uint64_t, filesystem::path> &b)
+                    {
+                        return a.first > b.first;
+                    });
+
+        mutex output_mutex;
+        ThreadPool pool(options.jobs);
+        for(auto const &f : files)
+        {
+            auto &p = f.second;
+            pool.Submit([&]()
+                        {
+                            stringstream ss;
+                            callback(options, p, ss, callback_data);
+
+                            lock_guard<mutex> lock(output_mutex);
+                            cout << ss.str() << flush;
+                        });
+        }
+        pool.Wait();
+    }
+}
+
+
 
 int main(int argc, char *argv[])
 {
@@ -87,10 +173,19 @@ int main(int argc, char *argv[])
         }
         else
         {
+            // index cache files are written while processing, fail early instead of on every track
+            if(!options.index_cache_path.empty())
+            {
+                std::error_code ec;
+                filesystem::create_directories(options.index_cache_path, ec);
+                if(!filesystem::is_directory(options.index_cache_path))
+                    throw_line("unable to create index cache directory (" + options.index_cache_path + ")");
+            }
+
             if(options.mode == Options::Mode::INFO)
             {
                 // if no individual info options specified enable all
-                bool enable_all = true;
+                bool enable_all = !options.header_check;
                 for(uint32_t i = 0; i < dim(options.info); ++i)
                 {
                     if(options.info[i])
@@ -113,7 +208,12 @@ int main(int argc, char *argv[])
                 if(filesystem::exists(options.dat_path))
                     dat = make_unique<DAT>(options.dat_path);
 
-                recursive_process(submission, dat.get(), options, ".cue");
+                std::unique_ptr<HashCache> hash_cache;
+                if(!options.hash_cache_path.empty())
+                    hash_cache = make_unique<HashCache>(options.hash_cache_path);
+
+                SubmissionContext context{dat.get(), hash_cache.get()};
+                recursive_process(submission, &context, options, ".cue");
             }
             else
             {
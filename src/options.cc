@@ -14,6 +14,29 @@ const std::unordered_map<std::string, Options::Mode> Options::_MODES =
 };
 
 
+const std::unordered_map<std::string, Options::VerifyPolicy> Options::_VERIFY_POLICIES =
+{
+    {"strict", VerifyPolicy::STRICT},
+    {"fast", VerifyPolicy::FAST}
+};
+
+
+const std::unordered_map<std::string, AsyncReader::Engine> Options::_IO_ENGINES =
+{
+    {"auto", AsyncReader::Engine::AUTO},
+    {"uring", AsyncReader::Engine::URING},
+    {"pread", AsyncReader::Engine::PREAD}
+};
+
+
+const std::unordered_map<std::string, AsyncReader::Cache> Options::_IO_CACHES =
+{
+    {"keep", AsyncReader::Cache::KEEP},
+    {"direct", AsyncReader::Cache::DIRECT},
+    {"drop", AsyncReader::Cache::DROP}
+};
+
+
 Options::Options()
     : basename("redump_info")
     , mode(Mode::INFO)
@@ -22,10 +45,25 @@ Options::Options()
     , verbose(false)
     , recursive(false)
     , extension("bin")
+    , jobs(1)
+    , fs_jobs(0)
+    , mmap(false)
     // info
+    , header_check(false)
     , batch(false)
     // submission
     , overwrite(false)
+    , verify("strict")
+    , verify_policy(VerifyPolicy::STRICT)
+    , verify_threads(0)
+    , tile_size(0)
+    , track_jobs(0)
+    , io_engine("auto")
+    , io_engine_type(AsyncReader::Engine::AUTO)
+    , io_cache("keep")
+    , io_cache_type(AsyncReader::Cache::KEEP)
+    , io_queue_depth(16)
+    , io_block_size(256 * 1024)
 {
     for(uint32_t i = 0; i < dim(info); ++i)
         info[i] = false;
@@ -45,6 +83,15 @@ Options::Options(int argc, const char *argv[])
     if(found != std::string::npos)
         basename = basename.substr(0, found);
 
+    // numeric option values are converted after parsing
+    std::string jobs_value;
+    std::string fs_jobs_value;
+    std::string verify_threads_value;
+    std::string tile_size_value;
+    std::string track_jobs_value;
+    std::string io_queue_depth_value;
+    std::string io_block_size_value;
+
     std::string *o_value = nullptr;
     for(int i = 1; i < argc; ++i)
     {
@@ -66,6 +113,14 @@ Options::Options(int argc, const char *argv[])
                     recursive = true;
                 else if(key == "--extension" || key == "-e")
                     o_value = &extension;
+                else if(key == "--jobs" || key == "-j")
+                    o_value = &jobs_value;
+                else if(key == "--fs-jobs")
+                    o_value = &fs_jobs_value;
+                else if(key == "--index-cache")
+                    o_value = &index_cache_path;
+                else if(key == "--mmap")
+                    mmap = true;
 
                 // info
                 else if(key == "--start-msf")
@@ -78,6 +133,8 @@ Options::Options(int argc, const char *argv[])
                     pvd_time = true;
                 else if(key == "--file-offsets")
                     file_offsets = true;
+                else if(key == "--header-check")
+                    header_check = true;
 
                 // info PSX
                 else if(key == "--launcher")
@@ -97,6 +154,24 @@ Options::Options(int argc, const char *argv[])
                     o_value = &dat_path;
                 else if(key == "--overwrite")
                     overwrite = true;
+                else if(key == "--verify")
+                    o_value = &verify;
+                else if(key == "--verify-threads")
+                    o_value = &verify_threads_value;
+                else if(key == "--tile-size")
+                    o_value = &tile_size_value;
+                else if(key == "--track-jobs")
+                    o_value = &track_jobs_value;
+                else if(key == "--io-engine")
+                    o_value = &io_engine;
+                else if(key == "--io-cache")
+                    o_value = &io_cache;
+                else if(key == "--io-queue-depth")
+                    o_value = &io_queue_depth_value;
+                else if(key == "--io-block-size")
+                    o_value = &io_block_size_value;
+                else if(key == "--hash-cache")
+                    o_value = &hash_cache_path;
                 else if(key == "--mastering-code")
                 {
                     mastering_code = std::make_unique<std::string>();
@@ -175,6 +250,79 @@ Options::Options(int argc, const char *argv[])
             positional.pop_front();
         }
     }
+
+    // parse verification policy
+    {
+        auto it = _VERIFY_POLICIES.find(verify);
+        if(it == _VERIFY_POLICIES.end())
+            throw_line("unknown verification policy (" + verify + ")");
+        verify_policy = it->second;
+    }
+
+    // parse I/O engine
+    {
+        auto it = _IO_ENGINES.find(io_engine);
+        if(it == _IO_ENGINES.end())
+            throw_line("unknown I/O engine (" + io_engine + ")");
+        io_engine_type = it->second;
+    }
+
+    // parse I/O cache mode
+    {
+        auto it = _IO_CACHES.find(io_cache);
+        if(it == _IO_CACHES.end())
+            throw_line("unknown I/O cache mode (" + io_cache + ")");
+        io_cache_type = it->second;
+    }
+
+    if(!jobs_value.empty())
+        jobs = ParseUInt(jobs_value, "--jobs");
+    if(!fs_jobs_value.empty())
+        fs_jobs = ParseUInt(fs_jobs_value, "--fs-jobs");
+    // files processed in parallel already keep all cores busy
+    else if(jobs != 1)
+        fs_jobs = 1;
+    if(!verify_threads_value.empty())
+        verify_threads = ParseUInt(verify_threads_value, "--verify-threads");
+    if(!tile_size_value.empty())
+        tile_size = ParseUInt(tile_size_value, "--tile-size");
+    if(!track_jobs_value.empty())
+        track_jobs = ParseUInt(track_jobs_value, "--track-jobs");
+    if(!io_queue_depth_value.empty())
+    {
+        io_queue_depth = ParseUInt(io_queue_depth_value, "--io-queue-depth");
+        if(!io_queue_depth)
+            throw_line("invalid option value (--io-queue-depth " + io_queue_depth_value + ")");
+    }
+    if(!io_block_size_value.empty())
+    {
+        // KiB
+        uint32_t kib = ParseUInt(io_block_size_value, "--io-block-size");
+        if(!kib || kib > UINT32_MAX / 1024)
+            throw_line("invalid option value (--io-block-size " + io_block_size_value + ")");
+        io_block_size = kib * 1024;
+    }
+}
+
+
+uint32_t Options::ParseUInt(const std::string &value, const std::string &key)
+{
+    uint32_t v = 0;
+
+    try
+    {
+        size_t pos;
+        unsigned long long ull = std::stoull(value, &pos);
+        if(pos != value.size() || ull > UINT32_MAX)
+            throw std::out_of_range(value);
+        v = (uint32_t)ull;
+    }
+    catch(const std::logic_error &)
+    {
+        throw_line("invalid option value (" + key + " " + value + ")");
+    }
+
+    return v;
 }
 
 
@@ -219,6 +367,10 @@ void Options::PrintUsage(std::ostream &os)
     os << "\t--verbose,-V\tverbose output" << std::endl;
     os << "\t--recursive,-R\trecursively process subdirectories" << std::endl;
     os << "\t--extension,-e\tdefault CD track extension [bin]" << std::endl;
+    os << "\t--jobs,-j\tnumber of files processed in parallel, 0 for all cores [1]" << std::endl;
+    os << "\t--fs-jobs\tnumber of threads reading data track filesystem, 0 for all cores, 1 if --jobs isn't 1 [0]" << std::endl;
+    os << "\t--index-cache <path>\treuse data track filesystem index of unchanged files stored in the cache directory" << std::endl;
+    os << "\t--mmap\t\tmemory map data tracks, faster but an I/O error or a truncated file terminates the program" << std::endl;
     os << std::endl;
 
     os << "info options: " << std::endl;
@@ -227,6 +379,7 @@ void Options::PrintUsage(std::ostream &os)
     os << "\t--edc\t\tprint EDC information" << std::endl;
     os << "\t--pvd-time\t\tprint PVD creation date/time" << std::endl;
     os << "\t--file-offsets\t\tprint ISO9660 file offsets" << std::endl;
+    os << "\t--header-check\t\tprint sector ranges with missing sync or discontinuous MSF address" << std::endl;
 
     // PSX
     os << "\t--launcher\tprint startup executable path (PSX)" << std::endl;
@@ -240,6 +393,23 @@ void Options::PrintUsage(std::ostream &os)
     os << "submission options: " << std::endl;
     os << "\t--dat-file\t\t\tpath to redump DAT file" << std::endl;
     os << "\t--overwrite\t\t\toverwrite generated !submissionInfo_*.txt" << std::endl;
+    os << "\t--verify <value>\t\tECC/EDC verification policy [strict]" << std::endl;
+    os << "\t\t\t\t\tstrict: check ECC and EDC of every sector" << std::endl;
+    os << "\t\t\t\t\tfast: skip ECC if EDC matches, damage limited to ECC bytes is not counted" << std::endl;
+    os << "\t--verify-threads <value>\tnumber of ECC/EDC verification threads, 0 for all cores unless files or tracks are processed in parallel [0]" << std::endl;
+    os << "\t--tile-size <value>\t\thash and verify on one thread in tiles of value sectors, --verify-threads is ignored, 0 runs every hash on it's own thread [0]" << std::endl;
+    os << "\t--track-jobs <value>\t\tnumber of tracks of one disc hashed in parallel, 0 for all cores or 1 if --jobs isn't 1 [0]" << std::endl;
+    os << "\t--io-engine <value>\t\ttrack reader implementation [auto]" << std::endl;
+    os << "\t\t\t\t\tauto: io_uring if available, pread thread otherwise" << std::endl;
+    os << "\t\t\t\t\turing: io_uring (Linux only)" << std::endl;
+    os << "\t\t\t\t\tpread: blocking reads on a dedicated thread" << std::endl;
+    os << "\t--io-cache <value>\t\tpage cache usage by track reads [keep]" << std::endl;
+    os << "\t\t\t\t\tkeep: regular buffered reads" << std::endl;
+    os << "\t\t\t\t\tdirect: bypass page cache (O_DIRECT), drop is used if not supported" << std::endl;
+    os << "\t\t\t\t\tdrop: evict pages from cache right after they are read" << std::endl;
+    os << "\t--io-queue-depth <value>\tnumber of track reads in flight [16]" << std::endl;
+    os << "\t--io-block-size <value>\t\tsize of one track read in KiB [256]" << std::endl;
+    os << "\t--hash-cache <path>\t\treuse track checksums of unchanged files stored in the cache file" << std::endl;
     os << "\t--mastering-code <value>\tfill \"Mastering Code\" field with value" << std::endl;
     os << "\t--mastering-sid <value>\t\tfill \"Mastering SID Code\" field with value" << std::endl;
     os << "\t--data-mould-sid <value>\tfill \"Data-Side Mould SID Code\" field with value" << std::endl;
@@ -2,11 +2,13 @@
 
 
 
+#include <cstdint>
 #include <list>
 #include <memory>
 #include <ostream>
 #include <string>
 #include <unordered_map>
+#include "async_reader.hh"
 
 
 
@@ -22,6 +24,16 @@ struct Options
     };
     static const std::unordered_map<std::string, Mode> _MODES;
 
+    enum class VerifyPolicy
+    {
+        STRICT,
+        FAST
+    };
+    static const std::unordered_map<std::string, VerifyPolicy> _VERIFY_POLICIES;
+
+    static const std::unordered_map<std::string, AsyncReader::Engine> _IO_ENGINES;
+    static const std::unordered_map<std::string, AsyncReader::Cache> _IO_CACHES;
+
     Mode mode;
 
     std::string basename;
@@ -32,6 +44,10 @@ struct Options
     bool verbose;
     bool recursive;
     std::string extension;
+    uint32_t jobs;
+    uint32_t fs_jobs;
+    std::string index_cache_path;
+    bool mmap;
 
     // info
     union
@@ -52,11 +68,25 @@ struct Options
         };
         bool info[9];
     };
+    // reads the whole track, not enabled by default
+    bool header_check;
     bool batch;
 
     // submission
     std::string dat_path;
     bool overwrite;
+    std::string verify;
+    VerifyPolicy verify_policy;
+    uint32_t verify_threads;
+    uint32_t tile_size;
+    uint32_t track_jobs;
+    std::string io_engine;
+    AsyncReader::Engine io_engine_type;
+    std::string io_cache;
+    AsyncReader::Cache io_cache_type;
+    uint32_t io_queue_depth;
+    uint32_t io_block_size;
+    std::string hash_cache_path;
     // lazy way to distinguish between no key and key with an empty value
     std::unique_ptr<std::string> mastering_code;
     std::unique_ptr<std::string> mastering_sid;
@@ -75,6 +105,9 @@ struct Options
 
     void PrintVersion(std::ostream &os);
     void PrintUsage(std::ostream &os);
+
+private:
+    static uint32_t ParseUInt(const std::string &value, const std::string &key);
 };
 
 }
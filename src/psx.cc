@@ -1,4 +1,8 @@
-﻿#include <iomanip>
+﻿#include <algorithm>
+#include <fstream>
+#include <iomanip>
+#include <iterator>
+#include <limits>
 #include <regex>
 #include <set>
 #include <sstream>
@@ -18,10 +22,12 @@ std::string extract_exe_path(ImageBrowser &browser)
 {
 	std::string exe_path;
 
-	auto system_cnf = browser.RootDirectory()->SubEntry("SYSTEM.CNF");
+	auto system_cnf = browser.RootDirectory().SubEntry("SYSTEM.CNF");
 	if(system_cnf)
 	{
-		auto data = system_cnf->Read();
+		// SYSTEM.CNF is a few lines of text, bound the read in case directory record has a bogus size
+		const uint32_t SYSTEM_CNF_MAX_SIZE = 16 * cdrom::FORM1_DATA_SIZE;
+		auto data = system_cnf->ReadRange(0, SYSTEM_CNF_MAX_SIZE);
 		std::string data_str(data.begin(), data.end());
 		std::stringstream ss(data_str);
 
@@ -46,7 +52,7 @@ std::string extract_exe_path(ImageBrowser &browser)
 	}
 	else
 	{
-		auto psx_exe = browser.RootDirectory()->SubEntry("PSX.EXE");
+		auto psx_exe = browser.RootDirectory().SubEntry("PSX.EXE");
 		if(psx_exe)
 			exe_path = psx_exe->Name();
 	}
@@ -138,32 +144,85 @@ std::vector<std::string> detect_anti_modchip_string(ImageBrowser &browser)
 		0x82, 0xa8, 0x82, 0xbb, 0x82, 0xea, 0x82, 0xaa, 0x82, 0xa0, 0x82, 0xe8, 0x82, 0xdc, 0x82, 0xb7, 0x81, 0x42
 	};
 
-	browser.Iterate([&](const std::string &path, std::shared_ptr<ImageBrowser::Entry> d)
-	{
-		bool exit = false;
+	const uint64_t ANTIMOD_NOT_FOUND = std::numeric_limits<uint64_t>::max();
+	// bounds memory used per file regardless of it's size
+	const size_t ANTIMOD_SEARCH_WINDOW = 64 * 1024;
+	const size_t ANTIMOD_OVERLAP = std::max(sizeof(ANTIMOD_MESSAGE_EN), sizeof(ANTIMOD_MESSAGE_JP)) - 1;
 
-		auto fp((path.empty() ? "" : path + "/") + d->Name());
+	// files are searched in parallel, results are collected in traversal order
+	browser.Iterate(ImageBrowser::Delivery::ORDERED,
+	[&](const std::string &path, ImageBrowser::Entry d)
+	{
+		std::vector<std::string> file_entries;
 
-		if(!d->IsDummy() && !d->IsInterleaved())
+		if(!d.IsDummy() && !d.IsInterleaved())
 		{
-			auto data = d->Read(false, false);
+			auto fp((path.empty() ? "" : path + "/") + std::string(d.Name()));
 
-			auto it_en = search(data.begin(), data.end(), std::begin(ANTIMOD_MESSAGE_EN), std::end(ANTIMOD_MESSAGE_EN));
-            if(it_en != data.end())
-            {
-                std::stringstream ss;
-                ss << fp << " @ 0x" << std::hex << it_en - data.begin() << ": EN";
-                entries.emplace_back(ss.str());
-            }
-			auto it_jp = search(data.begin(), data.end(), std::begin(ANTIMOD_MESSAGE_JP), std::end(ANTIMOD_MESSAGE_JP));
-            if(it_jp != data.end())
-            {
-                std::stringstream ss;
-                ss << fp << " @ 0x" << std::hex << it_jp - data.begin() << ": JP";
-                entries.emplace_back(ss.str());
-            }
+			// file is streamed through a search window, tail of the window is kept so that a match spanning a chunk boundary isn't missed
+			const std::pair<const uint8_t *, const uint8_t *> messages[] =
+			{
+				{ (const uint8_t *)std::begin(ANTIMOD_MESSAGE_EN), (const uint8_t *)std::end(ANTIMOD_MESSAGE_EN) },
+				{ std::begin(ANTIMOD_MESSAGE_JP), std::end(ANTIMOD_MESSAGE_JP) }
+			};
+			const char *languages[] = { "EN", "JP" };
+			uint64_t positions[] = { ANTIMOD_NOT_FOUND, ANTIMOD_NOT_FOUND };
+
+			std::vector<uint8_t> window;
+			uint64_t window_offset = 0;
+			auto search_window = [&]()
+			{
+				bool found_all = true;
+				for(uint32_t i = 0; i < std::size(messages); ++i)
+				{
+					if(positions[i] == ANTIMOD_NOT_FOUND)
+					{
+						auto it = search(window.begin(), window.end(), messages[i].first, messages[i].second);
+						if(it != window.end())
+							positions[i] = window_offset + (it - window.begin());
+						else
+							found_all = false;
+					}
+				}
+
+				return found_all;
+			};
+
+			d.Read([&](const uint8_t *data, uint32_t size)
+			{
+				window.insert(window.end(), data, data + size);
+				if(window.size() < ANTIMOD_SEARCH_WINDOW)
+					return false;
+
+				if(search_window())
+					return true;
+
+				window_offset += window.size() - ANTIMOD_OVERLAP;
+				window.erase(window.begin(), window.end() - ANTIMOD_OVERLAP);
+
+				return false;
+			}, false, false);
+			search_window();
+
+			for(uint32_t i = 0; i < std::size(messages); ++i)
+			{
+				if(positions[i] != ANTIMOD_NOT_FOUND)
+				{
+					std::stringstream ss;
+					ss << fp << " @ 0x" << std::hex << positions[i] << ": " << languages[i];
+					file_entries.emplace_back(ss.str());
+				}
+			}
 		}
 
+		return file_entries;
+	},
+	[&](const std::string &, ImageBrowser::Entry, std::vector<std::string> &&file_entries)
+	{
+		bool exit = false;
+
+		entries.insert(entries.end(), file_entries.begin(), file_entries.end());
+
 		return exit;
 	});
 
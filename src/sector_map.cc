@@ -0,0 +1,98 @@
+#include <algorithm>
+#include "sector_map.hh"
+
+
+
+namespace redump_info
+{
+
+uint8_t SectorMap::Classify(const cdrom::Sector &sector)
+{
+    uint8_t flags = 0;
+
+    // zero check on machine words, sector size is a multiple of 8
+    const uint64_t *words = (const uint64_t *)&sector;
+    uint64_t accumulator = 0;
+    for(uint32_t i = 0; i < sizeof(sector) / sizeof(uint64_t); ++i)
+        accumulator |= words[i];
+    if(!accumulator)
+        return ZERO;
+
+    if(sector.header.mode == 1)
+        flags |= 1;
+    else if(sector.header.mode == 2)
+    {
+        flags |= 2;
+
+        uint8_t submode = sector.mode2.xa.sub_header.submode;
+        if(submode & (uint8_t)cdrom::CDXAMode::FORM2)
+        {
+            flags |= FORM2;
+            if(sector.mode2.xa.form2.edc)
+                flags |= FORM2_EDC;
+        }
+        if(submode & (uint8_t)cdrom::CDXAMode::AUDIO)
+            flags |= AUDIO;
+        if(submode & (uint8_t)cdrom::CDXAMode::VIDEO)
+            flags |= VIDEO;
+        if(submode & (uint8_t)cdrom::CDXAMode::DATA)
+            flags |= DATA;
+    }
+
+    return flags;
+}
+
+
+SectorMap::SectorMap(uint32_t sectors_count)
+    : _map(sectors_count, 0)
+{
+    ;
+}
+
+
+void SectorMap::Update(uint32_t lba, const cdrom::Sector *sectors, uint32_t count)
+{
+    count = std::min(count, lba < Size() ? Size() - lba : 0);
+    for(uint32_t i = 0; i < count; ++i)
+        _map[lba + i] = Classify(sectors[i]);
+}
+
+
+uint32_t SectorMap::Size() const
+{
+    return (uint32_t)_map.size();
+}
+
+
+uint8_t SectorMap::operator[](uint32_t lba) const
+{
+    return _map[lba];
+}
+
+
+uint8_t SectorMap::Mode(uint32_t lba) const
+{
+    return _map[lba] & MODE_MASK;
+}
+
+
+bool SectorMap::IsForm2(uint32_t lba) const
+{
+    return _map[lba] & FORM2;
+}
+
+
+uint8_t SectorMap::FileForm(uint32_t lba) const
+{
+    uint8_t form = 0;
+
+    uint8_t mode = Mode(lba);
+    if(mode == 1)
+        form = 1;
+    else if(mode == 2)
+        form = IsForm2(lba) ? 2 : 1;
+
+    return form;
+}
+
+}
@@ -0,0 +1,53 @@
+#pragma once
+
+
+
+#include <cstdint>
+#include <vector>
+#include "cdrom.hh"
+
+
+
+namespace redump_info
+{
+
+// one byte per sector classification of the whole track
+class SectorMap
+{
+public:
+    enum Flags : uint8_t
+    {
+        // 0 for sectors with invalid mode
+        MODE_MASK = 0x03,
+        // XA
+        FORM2 = 1 << 2,
+        // Form2 EDC field is not zeroed
+        FORM2_EDC = 1 << 3,
+        AUDIO = 1 << 4,
+        VIDEO = 1 << 5,
+        DATA = 1 << 6,
+        // every byte of the sector is zero
+        ZERO = 1 << 7
+    };
+
+    static uint8_t Classify(const cdrom::Sector &sector);
+
+    SectorMap(uint32_t sectors_count);
+
+    // classifies consecutive sectors, used to build the map on the fly while track is being read
+    void Update(uint32_t lba, const cdrom::Sector *sectors, uint32_t count);
+
+    uint32_t Size() const;
+    uint8_t operator[](uint32_t lba) const;
+
+    uint8_t Mode(uint32_t lba) const;
+    bool IsForm2(uint32_t lba) const;
+
+    // 0 - unknown, 1 - Mode1 or Mode2Form1, 2 - Mode2Form2
+    uint8_t FileForm(uint32_t lba) const;
+
+private:
+    std::vector<uint8_t> _map;
+};
+
+}
@@ -0,0 +1,220 @@
+#include <algorithm>
+#include <new>
+#include <thread>
+#include "sector_pipeline.hh"
+
+
+
+namespace redump_info
+{
+
+void SectorPipeline::AlignedDelete::operator()(cdrom::Sector *sectors) const
+{
+    operator delete[](sectors, std::align_val_t(BUFFER_ALIGNMENT));
+}
+
+
+SectorPipeline::SectorPipeline(uint32_t chunk_sectors, uint32_t chunks_count, uint32_t tile_sectors)
+    : _chunkSectors(chunk_sectors)
+    , _tileSectors(tile_sectors)
+    , _chunks(chunks_count)
+    , _stagesCount(0)
+    , _chunksRead(0)
+    , _finished(false)
+    , _aborted(false)
+{
+    for(auto &c : _chunks)
+    {
+        c.sectors.reset((cdrom::Sector *)operator new[](_chunkSectors * sizeof(cdrom::Sector), std::align_val_t(BUFFER_ALIGNMENT)));
+        c.count = 0;
+        c.blocks_left = 0;
+        c.pending = 0;
+    }
+}
+
+
+void SectorPipeline::AddConsumer(const Consumer &consumer)
+{
+    _consumers.push_back(consumer);
+}
+
+
+void SectorPipeline::Run(AsyncReader &reader, uint32_t sectors_count)
+{
+    _chunksRead = 0;
+    _finished = false;
+    _aborted = false;
+    _exception = nullptr;
+    for(auto &c : _chunks)
+        c.pending = 0;
+
+    std::vector<Consumer> stages;
+    if(_tileSectors)
+        stages.push_back([this](const cdrom::Sector *sectors, uint32_t count)
+                         {
+                             for(uint32_t i = 0; i < count; i += _tileSectors)
+                                 for(auto const &c : _consumers)
+                                     c(sectors + i, std::min(_tileSectors, count - i));
+                         });
+    else
+        stages = _consumers;
+    _stagesCount = (uint32_t)stages.size();
+
+    std::vector<std::thread> threads;
+    threads.reserve(stages.size());
+    for(auto const &s : stages)
+        threads.emplace_back(&SectorPipeline::ConsumerLoop, this, std::cref(s));
+
+    // reader stage, chunk is split into blocks and up to queue depth blocks are in flight,
+    // blocks complete in any order but chunks are handed over to consumers in order
+    uint32_t in_flight = 0;
+    try
+    {
+        uint64_t chunks_count = (sectors_count + _chunkSectors - 1) / _chunkSectors;
+        uint64_t chunk_bytes = (uint64_t)_chunkSectors * sizeof(cdrom::Sector);
+        uint64_t fill = 0;
+        uint32_t fill_offset = 0;
+
+        while(_chunksRead < chunks_count)
+        {
+            // keep read queue full
+            while(fill < chunks_count && in_flight < reader.QueueDepth())
+            {
+                auto &chunk = _chunks[fill % _chunks.size()];
+                if(!fill_offset)
+                {
+                    // slot still holds a chunk that is being read or consumed
+                    if(fill >= _chunksRead + _chunks.size())
+                        break;
+
+                    std::unique_lock<std::mutex> lock(_mutex);
+                    if(in_flight)
+                    {
+                        if(chunk.pending)
+                            break;
+                    }
+                    else
+                        _chunkReleased.wait(lock, [&]{ return !chunk.pending || _aborted; });
+                    if(_aborted)
+                        break;
+
+                    chunk.count = (uint32_t)std::min<uint64_t>(_chunkSectors, sectors_count - fill * _chunkSectors);
+                    chunk.blocks_left = (chunk.count * (uint32_t)sizeof(cdrom::Sector) + reader.BlockSize() - 1) / reader.BlockSize();
+                }
+
+                uint32_t chunk_size = chunk.count * (uint32_t)sizeof(cdrom::Sector);
+                uint32_t size = std::min(reader.BlockSize(), chunk_size - fill_offset);
+                reader.Submit((uint8_t *)chunk.sectors.get() + fill_offset, fill * chunk_bytes + fill_offset, size, fill);
+                ++in_flight;
+
+                fill_offset += size;
+                if(fill_offset == chunk_size)
+                {
+                    fill_offset = 0;
+                    ++fill;
+                }
+            }
+
+            {
+                std::lock_guard<std::mutex> lock(_mutex);
+                if(_aborted)
+                    break;
+            }
+
+            uint64_t completed = reader.Complete();
+            --in_flight;
+            --_chunks[completed % _chunks.size()].blocks_left;
+
+            // hand over all fully read chunks in order
+            uint64_t chunks_read = _chunksRead;
+            while(chunks_read < fill && !_chunks[chunks_read % _chunks.size()].blocks_left)
+                ++chunks_read;
+            if(chunks_read != _chunksRead)
+            {
+                {
+                    std::lock_guard<std::mutex> lock(_mutex);
+                    for(; _chunksRead < chunks_read; ++_chunksRead)
+                        _chunks[_chunksRead % _chunks.size()].pending = _stagesCount;
+                }
+                _chunkRead.notify_all();
+            }
+        }
+    }
+    catch(...)
+    {
+        Abort(std::current_exception());
+    }
+
+    // buffers can't be released while reads are in flight
+    for(; in_flight; --in_flight)
+    {
+        try
+        {
+            reader.Complete();
+        }
+        catch(...)
+        {
+            ;
+        }
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _finished = true;
+    }
+    _chunkRead.notify_all();
+
+    for(auto &t : threads)
+        t.join();
+
+    if(_exception)
+        std::rethrow_exception(_exception);
+}
+
+
+void SectorPipeline::ConsumerLoop(const Consumer &consumer)
+{
+    try
+    {
+        for(uint64_t i = 0; ; ++i)
+        {
+            auto &chunk = _chunks[i % _chunks.size()];
+
+            {
+                std::unique_lock<std::mutex> lock(_mutex);
+                _chunkRead.wait(lock, [&]{ return i < _chunksRead || _finished || _aborted; });
+                if(_aborted || i >= _chunksRead)
+                    break;
+            }
+
+            consumer(chunk.sectors.get(), chunk.count);
+
+            bool released;
+            {
+                std::lock_guard<std::mutex> lock(_mutex);
+                released = !--chunk.pending;
+            }
+            if(released)
+                _chunkReleased.notify_one();
+        }
+    }
+    catch(...)
+    {
+        Abort(std::current_exception());
+    }
+}
+
+
+void SectorPipeline::Abort(std::exception_ptr exception)
+{
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        if(!_exception)
+            _exception = exception;
+        _aborted = true;
+    }
+    _chunkRead.notify_all();
+    _chunkReleased.notify_all();
+}
+
+}
@@ -0,0 +1,69 @@
+#pragma once
+
+
+
+#include <condition_variable>
+#include <cstdint>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <vector>
+#include "async_reader.hh"
+#include "cdrom.hh"
+
+
+
+namespace redump_info
+{
+
+// reader stage fills a ring of sector chunks using asynchronous block reads, each consumer runs on it's own thread
+// and processes every chunk in order, chunk slot is reused when all consumers are done with it
+// in tiled mode all consumers run on one thread instead and are applied to a chunk tile by tile
+// while the tile is still in cache
+class SectorPipeline
+{
+public:
+    typedef std::function<void(const cdrom::Sector *sectors, uint32_t count)> Consumer;
+
+    SectorPipeline(uint32_t chunk_sectors, uint32_t chunks_count, uint32_t tile_sectors = 0);
+
+    void AddConsumer(const Consumer &consumer);
+    void Run(AsyncReader &reader, uint32_t sectors_count);
+
+private:
+    // page aligned so that buffers are usable for direct I/O
+    static const size_t BUFFER_ALIGNMENT = 4096;
+
+    struct AlignedDelete
+    {
+        void operator()(cdrom::Sector *sectors) const;
+    };
+
+    struct Chunk
+    {
+        std::unique_ptr<cdrom::Sector, AlignedDelete> sectors;
+        uint32_t count;
+        uint32_t blocks_left;
+        uint32_t pending;
+    };
+
+    uint32_t _chunkSectors;
+    uint32_t _tileSectors;
+    std::vector<Chunk> _chunks;
+    std::vector<Consumer> _consumers;
+
+    std::mutex _mutex;
+    std::condition_variable _chunkRead;
+    std::condition_variable _chunkReleased;
+    uint32_t _stagesCount;
+    uint64_t _chunksRead;
+    bool _finished;
+    bool _aborted;
+    std::exception_ptr _exception;
+
+    void ConsumerLoop(const Consumer &consumer);
+    void Abort(std::exception_ptr exception);
+};
+
+}
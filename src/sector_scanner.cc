@@ -0,0 +1,65 @@
+#include <algorithm>
+#include <cerrno>
+#include <cstddef>
+#include <cstring>
+#include "common.hh"
+#include "sector_scanner.hh"
+
+
+
+namespace redump_info
+{
+
+SectorScanner::SectorScanner(const SectorSource &source, uint32_t batch_sectors, uint32_t first_batch_sectors)
+    : _source(source)
+    , _sectorsScanned(0)
+    , _batchSectors(batch_sectors)
+    , _nextBatchSectors(std::min(first_batch_sectors, batch_sectors))
+    , _bufferSectors(0)
+{
+    ;
+}
+
+
+uint32_t SectorScanner::SectorsCount() const
+{
+    return _source.SectorsCount();
+}
+
+
+bool SectorScanner::Next(std::vector<Header> &headers)
+{
+    uint32_t count = std::min(_nextBatchSectors, _source.SectorsCount() - _sectorsScanned);
+    headers.resize(count);
+    if(!count)
+        return false;
+
+    // buffer grows with the batch size, mapped source doesn't use it
+    if(_bufferSectors < count)
+    {
+        _buffer.reset(new cdrom::Sector[count]);
+        _bufferSectors = count;
+    }
+
+    uint32_t requested = count;
+    auto sectors = _source.Sectors(_buffer.get(), _sectorsScanned, count);
+    if(count != requested)
+        throw_line(std::string("read failure (") + std::strerror(errno) + ")");
+    _sectorsScanned += count;
+    _nextBatchSectors = std::min(_nextBatchSectors * 2, _batchSectors);
+
+    // strided loads at fixed sector offsets, no branching on sector contents
+    auto data = (const uint8_t *)sectors;
+    for(uint32_t i = 0; i < count; ++i, data += sizeof(cdrom::Sector))
+    {
+        auto &h = headers[i];
+        memcpy(&h.address, data + offsetof(cdrom::Sector, header.address), sizeof(h.address));
+        h.mode = data[offsetof(cdrom::Sector, header.mode)];
+        h.submode = data[offsetof(cdrom::Sector, mode2.xa.sub_header.submode)];
+        memcpy(&h.form2_edc, data + offsetof(cdrom::Sector, mode2.xa.form2.edc), sizeof(h.form2_edc));
+    }
+
+    return true;
+}
+
+}
@@ -0,0 +1,47 @@
+#pragma once
+
+
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+#include "cdrom.hh"
+#include "sector_source.hh"
+
+
+
+namespace redump_info
+{
+
+// reads track in batches and extracts only header fields of every sector,
+// replaces per-sector reads for scans that don't need sector payload,
+// batches start small and grow as most scans are decided by the first sectors
+class SectorScanner
+{
+public:
+    struct Header
+    {
+        cdrom::Sector::Header::Address address;
+        uint8_t mode;
+        // valid for mode 2 sectors only
+        uint8_t submode;
+        uint32_t form2_edc;
+    };
+
+    SectorScanner(const SectorSource &source, uint32_t batch_sectors = 1024, uint32_t first_batch_sectors = 16);
+
+    uint32_t SectorsCount() const;
+
+    // extracts headers of the next batch of sectors, returns false at the end of track
+    bool Next(std::vector<Header> &headers);
+
+private:
+    const SectorSource &_source;
+    uint32_t _sectorsScanned;
+    uint32_t _batchSectors;
+    uint32_t _nextBatchSectors;
+    std::unique_ptr<cdrom::Sector[]> _buffer;
+    uint32_t _bufferSectors;
+};
+
+}
@@ -0,0 +1,225 @@
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+#include "common.hh"
+#include "sector_source.hh"
+
+
+
+namespace redump_info
+{
+
+std::unique_ptr<SectorSource> SectorSource::Open(const std::filesystem::path &track, bool mapped)
+{
+    std::unique_ptr<SectorSource> source;
+
+    // fallback if mapping isn't possible (empty file, special filesystem etc.)
+    if(mapped)
+    {
+        try
+        {
+            source = std::make_unique<MappedSectorSource>(track);
+        }
+        catch(const std::exception &)
+        {
+            ;
+        }
+    }
+
+    if(!source)
+        source = std::make_unique<FileSectorSource>(track);
+
+    return source;
+}
+
+
+SectorSource::SectorSource(uint32_t sectors_count)
+    : _sectorsCount(sectors_count)
+{
+    ;
+}
+
+
+uint32_t SectorSource::SectorsCount() const
+{
+    return _sectorsCount;
+}
+
+
+const cdrom::Sector *SectorSource::Sector(cdrom::Sector &buffer, uint32_t index) const
+{
+    uint32_t count = 1;
+    auto sector = Sectors(&buffer, index, count);
+
+    return count ? sector : nullptr;
+}
+
+
+void SectorSource::Advise(uint32_t, uint32_t, Access) const
+{
+    ;
+}
+
+
+FileSectorSource::FileSectorSource(const std::filesystem::path &track)
+    : SectorSource(0)
+{
+#ifdef _WIN32
+    _file = CreateFileW(track.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if(_file == INVALID_HANDLE_VALUE)
+        throw_line("unable to open file (" + track.generic_string() + ")");
+#else
+    _fd = open(track.c_str(), O_RDONLY);
+    if(_fd == -1)
+        throw_line("unable to open file (" + std::strerror(errno) + ")");
+#endif
+
+    _sectorsCount = (uint32_t)(std::filesystem::file_size(track) / sizeof(cdrom::Sector));
+}
+
+
+FileSectorSource::~FileSectorSource()
+{
+#ifdef _WIN32
+    CloseHandle(_file);
+#else
+    close(_fd);
+#endif
+}
+
+
+const cdrom::Sector *FileSectorSource::Sectors(cdrom::Sector *buffer, uint32_t index, uint32_t &count) const
+{
+    count = index < _sectorsCount ? std::min(count, _sectorsCount - index) : 0;
+
+    uint64_t offset = (uint64_t)index * sizeof(cdrom::Sector);
+    uint64_t size = (uint64_t)count * sizeof(cdrom::Sector);
+
+    // short reads are possible, only whole sectors are returned
+    uint64_t bytes_read = 0;
+    while(bytes_read < size)
+    {
+#ifdef _WIN32
+        OVERLAPPED overlapped = {};
+        overlapped.Offset = (DWORD)(offset + bytes_read);
+        overlapped.OffsetHigh = (DWORD)((offset + bytes_read) >> 32);
+        DWORD n = 0;
+        if(!ReadFile(_file, (uint8_t *)buffer + bytes_read, (DWORD)(size - bytes_read), &n, &overlapped) || !n)
+            break;
+#else
+        ssize_t n = pread(_fd, (uint8_t *)buffer + bytes_read, size - bytes_read, offset + bytes_read);
+        if(n == -1 && errno == EINTR)
+            continue;
+        if(n <= 0)
+            break;
+#endif
+        bytes_read += n;
+    }
+    count = (uint32_t)(bytes_read / sizeof(cdrom::Sector));
+
+    return buffer;
+}
+
+
+MappedSectorSource::MappedSectorSource(const std::filesystem::path &track)
+    : SectorSource(0)
+    , _sectors(nullptr)
+    , _size(0)
+{
+    std::error_code ec;
+    _size = std::filesystem::file_size(track, ec);
+    if(ec || !_size)
+        throw_line("unable to map file (" + track.generic_string() + ")");
+    _sectorsCount = (uint32_t)(_size / sizeof(cdrom::Sector));
+
+#ifdef _WIN32
+    _file = CreateFileW(track.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if(_file == INVALID_HANDLE_VALUE)
+        throw_line("unable to open file (" + track.generic_string() + ")");
+
+    _mapping = CreateFileMappingW(_file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    if(_mapping == nullptr)
+    {
+        CloseHandle(_file);
+        throw_line("unable to map file (" + track.generic_string() + ")");
+    }
+
+    _sectors = (const cdrom::Sector *)MapViewOfFile(_mapping, FILE_MAP_READ, 0, 0, 0);
+    if(_sectors == nullptr)
+    {
+        CloseHandle(_mapping);
+        CloseHandle(_file);
+        throw_line("unable to map file (" + track.generic_string() + ")");
+    }
+#else
+    int fd = open(track.c_str(), O_RDONLY);
+    if(fd == -1)
+        throw_line("unable to open file (" + std::strerror(errno) + ")");
+
+    // mapping keeps the file referenced, descriptor isn't needed anymore
+    void *address = mmap(nullptr, _size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if(address == MAP_FAILED)
+        throw_line("unable to map file (" + std::strerror(errno) + ")");
+
+    _sectors = (const cdrom::Sector *)address;
+
+    // filesystem traversal jumps between directory records and files
+    madvise(address, _size, MADV_RANDOM);
+#endif
+}
+
+
+MappedSectorSource::~MappedSectorSource()
+{
+#ifdef _WIN32
+    UnmapViewOfFile(_sectors);
+    CloseHandle(_mapping);
+    CloseHandle(_file);
+#else
+    munmap((void *)_sectors, _size);
+#endif
+}
+
+
+const cdrom::Sector *MappedSectorSource::Sectors(cdrom::Sector *, uint32_t index, uint32_t &count) const
+{
+    count = index < _sectorsCount ? std::min(count, _sectorsCount - index) : 0;
+
+    return _sectors + std::min(index, _sectorsCount);
+}
+
+
+void MappedSectorSource::Advise(uint32_t index, uint32_t count, Access access) const
+{
+#ifndef _WIN32
+    if(index >= _sectorsCount)
+        return;
+    count = std::min(count, _sectorsCount - index);
+
+    // range has to be page aligned
+    uint64_t page_size = sysconf(_SC_PAGESIZE);
+    uint64_t start = (uint64_t)index * sizeof(cdrom::Sector) / page_size * page_size;
+    uint64_t end = (uint64_t)(index + count) * sizeof(cdrom::Sector);
+    void *address = (uint8_t *)_sectors + start;
+
+    if(access == Access::SEQUENTIAL)
+    {
+        madvise(address, end - start, MADV_SEQUENTIAL);
+        madvise(address, end - start, MADV_WILLNEED);
+    }
+    else
+        madvise(address, end - start, MADV_RANDOM);
+#endif
+}
+
+}
@@ -0,0 +1,88 @@
+#pragma once
+
+
+
+#include <cstdint>
+#include <filesystem>
+#include <memory>
+#include "cdrom.hh"
+
+
+
+namespace redump_info
+{
+
+// random access to raw sectors of a track file, reads are positional and don't share any state
+// so one source can be used from multiple threads
+class SectorSource
+{
+public:
+    enum class Access
+    {
+        SEQUENTIAL,
+        RANDOM
+    };
+
+    // positional file reads by default, memory mapped on request if platform allows,
+    // beware that with mapping an I/O error or a file truncated while in use terminates the process (SIGBUS)
+    // instead of being reported as a read failure
+    static std::unique_ptr<SectorSource> Open(const std::filesystem::path &track, bool mapped = false);
+
+    virtual ~SectorSource() = default;
+
+    uint32_t SectorsCount() const;
+
+    // returns sector view, depending on backend it either points directly to the track data
+    // or to the provided buffer, nullptr on read failure
+    const cdrom::Sector *Sector(cdrom::Sector &buffer, uint32_t index) const;
+
+    // same for up to count consecutive sectors, buffer has to hold count sectors,
+    // count is updated to the number of sectors available, 0 on read failure
+    virtual const cdrom::Sector *Sectors(cdrom::Sector *buffer, uint32_t index, uint32_t &count) const = 0;
+
+    // access pattern hint for the range of sectors
+    virtual void Advise(uint32_t index, uint32_t count, Access access) const;
+
+protected:
+    uint32_t _sectorsCount;
+
+    SectorSource(uint32_t sectors_count);
+};
+
+
+class FileSectorSource : public SectorSource
+{
+public:
+    FileSectorSource(const std::filesystem::path &track);
+    ~FileSectorSource() override;
+
+    const cdrom::Sector *Sectors(cdrom::Sector *buffer, uint32_t index, uint32_t &count) const override;
+
+private:
+#ifdef _WIN32
+    void *_file;
+#else
+    int _fd;
+#endif
+};
+
+
+class MappedSectorSource : public SectorSource
+{
+public:
+    MappedSectorSource(const std::filesystem::path &track);
+    ~MappedSectorSource() override;
+
+    const cdrom::Sector *Sectors(cdrom::Sector *buffer, uint32_t index, uint32_t &count) const override;
+    void Advise(uint32_t index, uint32_t count, Access access) const override;
+
+private:
+    const cdrom::Sector *_sectors;
+    uint64_t _size;
+#ifdef _WIN32
+    void *_file;
+    void *_mapping;
+#endif
+};
+
+}
@@ -1,11 +1,19 @@
+#include "cpu.hh"
 #include "endian.hh"
 #include "sha1.hh"
 
+#ifdef RI_ARCH_X86
+#include <immintrin.h>
+#endif
+
 
 
 namespace redump_info
 {
 
+const SHA1::UpdateBlockFunction SHA1::_UPDATE_BLOCK(SHA1::SelectUpdateBlock());
+
+
 SHA1::SHA1()
 	: BlockHasher(16 * sizeof(uint32_t))
 	, _hash(DefaultHash())
@@ -21,6 +29,27 @@ std::vector<uint32_t> SHA1::DefaultHash()
 
 
 void SHA1::UpdateBlock(const uint8_t *block)
+{
+	_UPDATE_BLOCK(_hash.data(), block);
+}
+
+
+SHA1::UpdateBlockFunction SHA1::SelectUpdateBlock()
+{
+	auto &cpu = cpu_features();
+
+#ifdef RI_ARCH_X86
+	if(cpu.sha && cpu.sse41)
+		return UpdateBlockSHA;
+	if(cpu.ssse3)
+		return UpdateBlockSSSE3;
+#endif
+
+	return UpdateBlockScalar;
+}
+
+
+void SHA1::UpdateBlockScalar(uint32_t *hash, const uint8_t *block)
 {
 	uint32_t w[80];
 
@@ -36,11 +65,11 @@ void SHA1::UpdateBlock(const uint8_t *block)
 		w[i] = ROTL(w[i - 6] ^ w[i - 16] ^ w[i - 28] ^ w[i - 32], 2);
 
 	// initialize hash value for this chunk
-	uint32_t a = _hash[0];
-	uint32_t b = _hash[1];
-	uint32_t c = _hash[2];
-	uint32_t d = _hash[3];
-	uint32_t e = _hash[4];
+	uint32_t a = hash[0];
+	uint32_t b = hash[1];
+	uint32_t c = hash[2];
+	uint32_t d = hash[3];
+	uint32_t e = hash[4];
 
 	// main loop
 	for(uint32_t i = 0; i < 80; ++i)
@@ -77,14 +106,280 @@ void SHA1::UpdateBlock(const uint8_t *block)
 	}
 
 	// add this chunk's hash to result so far
-	_hash[0] += a;
-	_hash[1] += b;
-	_hash[2] += c;
-	_hash[3] += d;
-	_hash[4] += e;
+	hash[0] += a;
+	hash[1] += b;
+	hash[2] += c;
+	hash[3] += d;
+	hash[4] += e;
 }
 
 
+#ifdef RI_ARCH_X86
+
+// message schedule is computed four words at a time and K is folded in, rounds are scalar
+// 16-31: w[i + 3] depends on w[i], last lane is fixed up after the rotation
+// 32-79: alternative computation only depends on w[i - 6] and older so no fixup is needed
+RI_TARGET("ssse3")
+void SHA1::UpdateBlockSSSE3(uint32_t *hash, const uint8_t *block)
+{
+	alignas(16) uint32_t w[80];
+	alignas(16) uint32_t wk[80];
+
+	const __m128i MASK = _mm_set_epi8(12, 13, 14, 15, 8, 9, 10, 11, 4, 5, 6, 7, 0, 1, 2, 3);
+	const uint32_t K[] = {0x5A827999, 0x6ED9EBA1, 0x8F1BBCDC, 0xCA62C1D6};
+
+	for(uint32_t i = 0; i < 16; i += 4)
+		_mm_store_si128((__m128i *)&w[i], _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(block + i * sizeof(uint32_t))), MASK));
+
+	for(uint32_t i = 16; i < 32; i += 4)
+	{
+		__m128i x = _mm_xor_si128(_mm_loadu_si128((const __m128i *)&w[i - 8]), _mm_loadu_si128((const __m128i *)&w[i - 14]));
+		x = _mm_xor_si128(x, _mm_load_si128((const __m128i *)&w[i - 16]));
+		x = _mm_xor_si128(x, _mm_srli_si128(_mm_loadu_si128((const __m128i *)&w[i - 4]), 4));
+		x = _mm_or_si128(_mm_slli_epi32(x, 1), _mm_srli_epi32(x, 31));
+
+		__m128i fixup = _mm_slli_si128(x, 12);
+		x = _mm_xor_si128(x, _mm_or_si128(_mm_slli_epi32(fixup, 1), _mm_srli_epi32(fixup, 31)));
+
+		_mm_store_si128((__m128i *)&w[i], x);
+	}
+
+	for(uint32_t i = 32; i < 80; i += 4)
+	{
+		__m128i x = _mm_xor_si128(_mm_loadu_si128((const __m128i *)&w[i - 6]), _mm_load_si128((const __m128i *)&w[i - 16]));
+		x = _mm_xor_si128(x, _mm_load_si128((const __m128i *)&w[i - 28]));
+		x = _mm_xor_si128(x, _mm_load_si128((const __m128i *)&w[i - 32]));
+		x = _mm_or_si128(_mm_slli_epi32(x, 2), _mm_srli_epi32(x, 30));
+
+		_mm_store_si128((__m128i *)&w[i], x);
+	}
+
+	for(uint32_t i = 0; i < 80; i += 4)
+		_mm_store_si128((__m128i *)&wk[i], _mm_add_epi32(_mm_load_si128((const __m128i *)&w[i]), _mm_set1_epi32(K[i / 20])));
+
+	uint32_t a = hash[0];
+	uint32_t b = hash[1];
+	uint32_t c = hash[2];
+	uint32_t d = hash[3];
+	uint32_t e = hash[4];
+
+	for(uint32_t i = 0; i < 80; ++i)
+	{
+		uint32_t f;
+		if(i < 20)
+			f = d ^ (b & (c ^ d));
+		else if(i < 40 || i >= 60)
+			f = b ^ c ^ d;
+		else
+			f = (b & c) | (d & (b | c));
+
+		uint32_t temp = ROTL(a, 5) + f + e + wk[i];
+		e = d;
+		d = c;
+		c = ROTL(b, 30);
+		b = a;
+		a = temp;
+	}
+
+	hash[0] += a;
+	hash[1] += b;
+	hash[2] += c;
+	hash[3] += d;
+	hash[4] += e;
+}
+
+
+// Intel SHA extensions, four rounds per instruction
+RI_TARGET("sha,sse4.1")
+void SHA1::UpdateBlockSHA(uint32_t *hash, const uint8_t *block)
+{
+	const __m128i MASK = _mm_set_epi64x(0x0001020304050607, 0x08090A0B0C0D0E0F);
+
+	// state is kept with 'a' in the most significant lane
+	__m128i abcd = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i *)hash), 0x1B);
+	__m128i e0 = _mm_set_epi32(hash[4], 0, 0, 0);
+	__m128i e1;
+
+	__m128i abcd_save = abcd;
+	__m128i e0_save = e0;
+
+	__m128i msg0, msg1, msg2, msg3;
+
+	// rounds 0-3
+	msg0 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(block + 0)), MASK);
+	e0 = _mm_add_epi32(e0, msg0);
+	e1 = abcd;
+	abcd = _mm_sha1rnds4_epu32(abcd, e0, 0);
+
+	// rounds 4-7
+	msg1 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(block + 16)), MASK);
+	e1 = _mm_sha1nexte_epu32(e1, msg1);
+	e0 = abcd;
+	abcd = _mm_sha1rnds4_epu32(abcd, e1, 0);
+	msg0 = _mm_sha1msg1_epu32(msg0, msg1);
+
+	// rounds 8-11
+	msg2 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(block + 32)), MASK);
+	e0 = _mm_sha1nexte_epu32(e0, msg2);
+	e1 = abcd;
+	abcd = _mm_sha1rnds4_epu32(abcd, e0, 0);
+	msg1 = _mm_sha1msg1_epu32(msg1, msg2);
+	msg0 = _mm_xor_si128(msg0, msg2);
+
+	// rounds 12-15
+	msg3 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(block + 48)), MASK);
+	e1 = _mm_sha1nexte_epu32(e1, msg3);
+	e0 = abcd;
+	msg0 = _mm_sha1msg2_epu32(msg0, msg3);
+	abcd = _mm_sha1rnds4_epu32(abcd, e1, 0);
+	msg2 = _mm_sha1msg1_epu32(msg2, msg3);
+	msg1 = _mm_xor_si128(msg1, msg3);
+
+	// rounds 16-19
+	e0 = _mm_sha1nexte_epu32(e0, msg0);
+	e1 = abcd;
+	msg1 = _mm_sha1msg2_epu32(msg1, msg0);
+	abcd = _mm_sha1rnds4_epu32(abcd, e0, 0);
+	msg3 = _mm_sha1msg1_epu32(msg3, msg0);
+	msg2 = _mm_xor_si128(msg2, msg0);
+
+	// rounds 20-23
+	e1 = _mm_sha1nexte_epu32(e1, msg1);
+	e0 = abcd;
+	msg2 = _mm_sha1msg2_epu32(msg2, msg1);
+	abcd = _mm_sha1rnds4_epu32(abcd, e1, 1);
+	msg0 = _mm_sha1msg1_epu32(msg0, msg1);
+	msg3 = _mm_xor_si128(msg3, msg1);
+
+	// rounds 24-27
+	e0 = _mm_sha1nexte_epu32(e0, msg2);
+	e1 = abcd;
+	msg3 = _mm_sha1msg2_epu32(msg3, msg2);
+	abcd = _mm_sha1rnds4_epu32(abcd, e0, 1);
+	msg1 = _mm_sha1msg1_epu32(msg1, msg2);
+	msg0 = _mm_xor_si128(msg0, msg2);
+
+	// rounds 28-31
+	e1 = _mm_sha1nexte_epu32(e1, msg3);
+	e0 = abcd;
+	msg0 = _mm_sha1msg2_epu32(msg0, msg3);
+	abcd = _mm_sha1rnds4_epu32(abcd, e1, 1);
+	msg2 = _mm_sha1msg1_epu32(msg2, msg3);
+	msg1 = _mm_xor_si128(msg1, msg3);
+
+	// rounds 32-35
+	e0 = _mm_sha1nexte_epu32(e0, msg0);
+	e1 = abcd;
+	msg1 = _mm_sha1msg2_epu32(msg1, msg0);
+	abcd = _mm_sha1rnds4_epu32(abcd, e0, 1);
+	msg3 = _mm_sha1msg1_epu32(msg3, msg0);
+	msg2 = _mm_xor_si128(msg2, msg0);
+
+	// rounds 36-39
+	e1 = _mm_sha1nexte_epu32(e1, msg1);
+	e0 = abcd;
+	msg2 = _mm_sha1msg2_epu32(msg2, msg1);
+	abcd = _mm_sha1rnds4_epu32(abcd, e1, 1);
+	msg0 = _mm_sha1msg1_epu32(msg0, msg1);
+	msg3 = _mm_xor_si128(msg3, msg1);
+
+	// rounds 40-43
+	e0 = _mm_sha1nexte_epu32(e0, msg2);
+	e1 = abcd;
+	msg3 = _mm_sha1msg2_epu32(msg3, msg2);
+	abcd = _mm_sha1rnds4_epu32(abcd, e0, 2);
+	msg1 = _mm_sha1msg1_epu32(msg1, msg2);
+	msg0 = _mm_xor_si128(msg0, msg2);
+
+	// rounds 44-47
+	e1 = _mm_sha1nexte_epu32(e1, msg3);
+	e0 = abcd;
+	msg0 = _mm_sha1msg2_epu32(msg0, msg3);
+	abcd = _mm_sha1rnds4_epu32(abcd, e1, 2);
+	msg2 = _mm_sha1msg1_epu32(msg2, msg3);
+	msg1 = _mm_xor_si128(msg1, msg3);
+
+	// rounds 48-51
+	e0 = _mm_sha1nexte_epu32(e0, msg0);
+	e1 = abcd;
+	msg1 = _mm_sha1msg2_epu32(msg1, msg0);
+	abcd = _mm_sha1rnds4_epu32(abcd, e0, 2);
+	msg3 = _mm_sha1msg1_epu32(msg3, msg0);
+	msg2 = _mm_xor_si128(msg2, msg0);
+
+	// rounds 52-55
+	e1 = _mm_sha1nexte_epu32(e1, msg1);
+	e0 = abcd;
+	msg2 = _mm_sha1msg2_epu32(msg2, msg1);
+	abcd = _mm_sha1rnds4_epu32(abcd, e1, 2);
+	msg0 = _mm_sha1msg1_epu32(msg0, msg1);
+	msg3 = _mm_xor_si128(msg3, msg1);
+
+	// rounds 56-59
+	e0 = _mm_sha1nexte_epu32(e0, msg2);
+	e1 = abcd;
+	msg3 = _mm_sha1msg2_epu32(msg3, msg2);
+	abcd = _mm_sha1rnds4_epu32(abcd, e0, 2);
+	msg1 = _mm_sha1msg1_epu32(msg1, msg2);
+	msg0 = _mm_xor_si128(msg0, msg2);
+
+	// rounds 60-63
+	e1 = _mm_sha1nexte_epu32(e1, msg3);
+	e0 = abcd;
+	msg0 = _mm_sha1msg2_epu32(msg0, msg3);
+	abcd = _mm_sha1rnds4_epu32(abcd, e1, 3);
+	msg2 = _mm_sha1msg1_epu32(msg2, msg3);
+	msg1 = _mm_xor_si128(msg1, msg3);
+
+	// rounds 64-67
+	e0 = _mm_sha1nexte_epu32(e0, msg0);
+	e1 = abcd;
+	msg1 = _mm_sha1msg2_epu32(msg1, msg0);
+	abcd = _mm_sha1rnds4_epu32(abcd, e0, 3);
+	msg3 = _mm_sha1msg1_epu32(msg3, msg0);
+	msg2 = _mm_xor_si128(msg2, msg0);
+
+	// rounds 68-71
+	e1 = _mm_sha1nexte_epu32(e1, msg1);
+	e0 = abcd;
+	msg2 = _mm_sha1msg2_epu32(msg2, msg1);
+	abcd = _mm_sha1rnds4_epu32(abcd, e1, 3);
+	msg3 = _mm_xor_si128(msg3, msg1);
+
+	// rounds 72-75
+	e0 = _mm_sha1nexte_epu32(e0, msg2);
+	e1 = abcd;
+	msg3 = _mm_sha1msg2_epu32(msg3, msg2);
+	abcd = _mm_sha1rnds4_epu32(abcd, e0, 3);
+
+	// rounds 76-79
+	e1 = _mm_sha1nexte_epu32(e1, msg3);
+	e0 = abcd;
+	abcd = _mm_sha1rnds4_epu32(abcd, e1, 3);
+
+	e0 = _mm_sha1nexte_epu32(e0, e0_save);
+	abcd = _mm_add_epi32(abcd, abcd_save);
+
+	_mm_storeu_si128((__m128i *)hash, _mm_shuffle_epi32(abcd, 0x1B));
+	hash[4] = _mm_extract_epi32(e0, 3);
+}
+
+#else
+
+void SHA1::UpdateBlockSSSE3(uint32_t *hash, const uint8_t *block)
+{
+	UpdateBlockScalar(hash, block);
+}
+
+
+void SHA1::UpdateBlockSHA(uint32_t *hash, const uint8_t *block)
+{
+	UpdateBlockScalar(hash, block);
+}
+
+#endif
+
+
 uint64_t SHA1::ConvertML(uint64_t ml)
 {
 	return endian_swap(ml);
@@ -15,6 +15,9 @@ public:
 	SHA1();
 
 private:
+	typedef void (*UpdateBlockFunction)(uint32_t *hash, const uint8_t *block);
+	static const UpdateBlockFunction _UPDATE_BLOCK;
+
 	std::vector<uint32_t> _hash;
 
 	virtual void UpdateBlock(const uint8_t *block);
@@ -22,6 +25,11 @@ private:
 	virtual std::vector<uint32_t> Hash();
 
 	std::vector<uint32_t> DefaultHash();
+
+	static UpdateBlockFunction SelectUpdateBlock();
+	static void UpdateBlockScalar(uint32_t *hash, const uint8_t *block);
+	static void UpdateBlockSSSE3(uint32_t *hash, const uint8_t *block);
+	static void UpdateBlockSHA(uint32_t *hash, const uint8_t *block);
 };
 
 }
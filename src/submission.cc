@@ -1,3 +1,4 @@
+#include <algorithm>
 #include <fstream>
 #include <iostream>
 #include <regex>
@@ -5,17 +6,23 @@
 #include <sstream>
 #include <unordered_map>
 #include <unordered_set>
+#include <vector>
+#include "async_reader.hh"
 #include "cdrom.hh"
 #include "common.hh"
 #include "crc/Crc32.h"
 #include "dat.hh"
 #include "ecc_edc.hh"
+#include "hash_cache.hh"
 #include "image_browser.hh"
 #include "md5.hh"
 #include "psx.hh"
+#include "sector_map.hh"
+#include "sector_pipeline.hh"
 #include "sha1.hh"
 #include "strings.hh"
 #include "submission.hh"
+#include "thread_pool.hh"
 
 
 
@@ -215,10 +222,16 @@ struct SubmissionInfo
 };
 
 
-const uint32_t SECTORS_AT_ONCE = 10000;
+// pipeline ring geometry, SECTORS_AT_ONCE * PIPELINE_CHUNKS sectors are kept in memory,
+// chunk size has to be a multiple of direct I/O alignment
+const uint32_t SECTORS_AT_ONCE = 1024;
+static_assert(SECTORS_AT_ONCE * sizeof(cdrom::Sector) % AsyncReader::DIRECT_ALIGNMENT == 0, "pipeline chunk is not aligned for direct I/O");
+const uint32_t PIPELINE_CHUNKS = 8;
 
 
-void edc_ecc_check(uint32_t &errors, bool &edc_mode, cdrom::Sector &sector)
+// ECC is only needed to detect damage that EDC doesn't cover (ECC bytes themselves),
+// a mismatching EDC already counts the sector as one error so ECC is never computed for it
+void edc_ecc_check(uint32_t &errors, bool &edc_mode, const cdrom::Sector &sector, Options::VerifyPolicy policy)
 {
     switch(sector.header.mode)
     {
@@ -226,13 +239,15 @@ void edc_ecc_check(uint32_t &errors, bool &edc_mode, cdrom::Sector &sector)
     {
         bool error_detected = false;
 
-        cdrom::Sector::ECC ecc(ECC().Generate((uint8_t *)&sector.header));
-        if(memcmp(ecc.p_parity, sector.mode1.ecc.p_parity, sizeof(ecc.p_parity)) || memcmp(ecc.q_parity, sector.mode1.ecc.q_parity, sizeof(ecc.q_parity)))
-            error_detected = true;
-
         uint32_t edc = EDC().ComputeBlock(0, (uint8_t *)&sector, offsetof(cdrom::Sector, mode1.edc));
         if(edc != sector.mode1.edc)
             error_detected = true;
+        else if(policy == Options::VerifyPolicy::STRICT)
+        {
+            cdrom::Sector::ECC ecc(ECC().Generate((uint8_t *)&sector.header));
+            if(memcmp(ecc.p_parity, sector.mode1.ecc.p_parity, sizeof(ecc.p_parity)) || memcmp(ecc.q_parity, sector.mode1.ecc.q_parity, sizeof(ecc.q_parity)))
+                error_detected = true;
+        }
 
         // log dual ECC/EDC mismatch as one error
         if(error_detected)
@@ -271,18 +286,17 @@ void edc_ecc_check(uint32_t &errors, bool &edc_mode, cdrom::Sector &sector)
                                               offsetof(cdrom::Sector, mode2.xa.form1.edc) - offsetof(cdrom::Sector, mode2.xa.sub_header));
             if(edc != sector.mode2.xa.form1.edc)
                 error_detected = true;
-
             // ECC
-            // modifies sector, make sure sector data is not used after ECC calculation, otherwise header has to be restored
-            cdrom::Sector::Header header = sector.header;
-            fill_n((uint8_t *)&sector.header, sizeof(sector.header), 0);
-
-            cdrom::Sector::ECC ecc(ECC().Generate((uint8_t *)&sector.header));
-            if(memcmp(ecc.p_parity, sector.mode2.xa.form1.ecc.p_parity, sizeof(ecc.p_parity)) || memcmp(ecc.q_parity, sector.mode2.xa.form1.ecc.q_parity, sizeof(ecc.q_parity)))
-                error_detected = true;
+            else if(policy == Options::VerifyPolicy::STRICT)
+            {
+                // computed with zeroed address, sector buffer is shared with other pipeline stages so work on a copy
+                cdrom::Sector sector_copy(sector);
+                fill_n((uint8_t *)&sector_copy.header, sizeof(sector_copy.header), 0);
 
-            // restore modified sector header
-            sector.header = header;
+                cdrom::Sector::ECC ecc(ECC().Generate((uint8_t *)&sector_copy.header));
+                if(memcmp(ecc.p_parity, sector.mode2.xa.form1.ecc.p_parity, sizeof(ecc.p_parity)) || memcmp(ecc.q_parity, sector.mode2.xa.form1.ecc.q_parity, sizeof(ecc.q_parity)))
+                    error_detected = true;
+            }
 
             // log dual ECC/EDC mismatch as one error
             if(error_detected)
@@ -297,11 +311,34 @@ void edc_ecc_check(uint32_t &errors, bool &edc_mode, cdrom::Sector &sector)
 }
 
 
-DAT::Game::Rom create_file_entry(const filesystem::path &p, string name, SubmissionInfo &info, bool data_track)
+// result of one track processing, tracks are processed concurrently and merged in CUE order afterwards
+struct FileEntry
+{
+    DAT::Game::Rom rom;
+    bool data_track;
+    uint32_t errors;
+    bool edc;
+    // data track sector classification built while hashing, not available on hash cache hit
+    shared_ptr<SectorMap> sector_map;
+};
+
+
+FileEntry create_file_entry(const filesystem::path &p, string name, bool data_track, const Options &o, uint32_t verify_threads, HashCache *hash_cache)
 {
     auto file_path(p / name);
     uint32_t size = (uint32_t)filesystem::file_size(file_path);
 
+    // unchanged file, verification results are reused only if they were produced with the same policy
+    HashCache::Key cache_key;
+    if(hash_cache != nullptr)
+    {
+        cache_key = HashCache::FileKey(file_path);
+
+        HashCache::Entry entry;
+        if(hash_cache->Find(entry, cache_key) && (!data_track || (entry.verified && entry.verify_policy == o.verify)))
+            return FileEntry{DAT::Game::Rom{name, size, entry.crc, entry.md5, entry.sha1}, data_track, entry.errors, entry.edc, nullptr};
+    }
+
     uint32_t crc = 0;
     MD5 bh_md5;
     SHA1 bh_sha1;
@@ -309,35 +346,67 @@ DAT::Game::Rom create_file_entry(const filesystem::path &p, string name, Submiss
     uint32_t errors = 0;
     bool edc_mode = false;
 
-    ifstream ifs(file_path, ios::binary);
-    if(ifs.fail())
-        throw_line("unable to open file (" + file_path.generic_string() + ")");
-
-    unique_ptr<cdrom::Sector[]> sectors(new cdrom::Sector[SECTORS_AT_ONCE]);
-    for(uint32_t sectors_left = (uint32_t)size / sizeof(cdrom::Sector); sectors_left; )
+    uint32_t sectors_count = size / (uint32_t)sizeof(cdrom::Sector);
+    shared_ptr<SectorMap> sector_map;
+
+    auto reader = AsyncReader::Open(file_path, o.io_engine_type, o.io_cache_type, o.io_queue_depth, o.io_block_size);
+
+    // every consumer runs on it's own thread and shares read buffers with the others,
+    // or all of them are applied tile by tile on one thread if tile size is set
+    SectorPipeline pipeline(SECTORS_AT_ONCE, PIPELINE_CHUNKS, o.tile_size);
+    pipeline.AddConsumer([&](const cdrom::Sector *sectors, uint32_t count)
+                         {
+                             crc = crc32_fast(sectors, count * sizeof(cdrom::Sector), crc);
+                         });
+    pipeline.AddConsumer([&](const cdrom::Sector *sectors, uint32_t count)
+                         {
+                             bh_md5.Update((uint8_t *)sectors, count * sizeof(cdrom::Sector));
+                         });
+    pipeline.AddConsumer([&](const cdrom::Sector *sectors, uint32_t count)
+                         {
+                             bh_sha1.Update((uint8_t *)sectors, count * sizeof(cdrom::Sector));
+                         });
+    // sectors are independent, every verification consumer takes it's own slice of each chunk,
+    // consumers progress independently through the chunk ring so there is no barrier per chunk,
+    // counters are merged after the run so the result doesn't depend on scheduling
+    // in tiled mode all consumers run on one thread, slicing would only add overhead
+    uint32_t slices_count = o.tile_size ? 1 : max(verify_threads, 1u);
+    vector<uint32_t> slice_errors(slices_count, 0);
+    unique_ptr<bool[]> slice_edc_mode(new bool[slices_count]());
+    if(data_track)
     {
-        uint32_t sectors_to_process(min(SECTORS_AT_ONCE, sectors_left));
-
-        ifs.read((char *)sectors.get(), sectors_to_process * sizeof(cdrom::Sector));
-
-        crc = crc32_fast(sectors.get(), sectors_to_process * sizeof(cdrom::Sector), crc);
-        bh_md5.Update((uint8_t *)sectors.get(), sectors_to_process * sizeof(cdrom::Sector));
-        bh_sha1.Update((uint8_t *)sectors.get(), sectors_to_process * sizeof(cdrom::Sector));
-
-        if(data_track)
-            for(uint32_t i = 0; i < sectors_to_process; ++i)
-                edc_ecc_check(errors, edc_mode, sectors[i]);
-
-        sectors_left -= sectors_to_process;
+        for(uint32_t s = 0; s < slices_count; ++s)
+            pipeline.AddConsumer([&, s](const cdrom::Sector *sectors, uint32_t count)
+                                 {
+                                     uint32_t slice_size = (count + slices_count - 1) / slices_count;
+                                     for(uint32_t i = s * slice_size, n = min(count, (s + 1) * slice_size); i < n; ++i)
+                                         edc_ecc_check(slice_errors[s], slice_edc_mode[s], sectors[i], o.verify_policy);
+                                 });
+
+        // classification comes for free while sectors are in memory, filesystem routines use it later
+        sector_map = make_shared<SectorMap>(sectors_count);
+        pipeline.AddConsumer([&, lba = (uint32_t)0](const cdrom::Sector *sectors, uint32_t count) mutable
+                             {
+                                 sector_map->Update(lba, sectors, count);
+                                 lba += count;
+                             });
     }
 
-    if(data_track)
+    pipeline.Run(*reader, sectors_count);
+
+    for(uint32_t s = 0; s < slices_count; ++s)
     {
-        info.error_count = to_string(errors);
-        info.edc = edc_mode ? "Yes" : "No";
+        errors += slice_errors[s];
+        edc_mode = edc_mode || slice_edc_mode[s];
     }
 
-    return DAT::Game::Rom{name, size, crc, bh_md5.Final(), bh_sha1.Final()};
+    DAT::Game::Rom rom{name, size, crc, bh_md5.Final(), bh_sha1.Final()};
+
+    // file modified while it was read, checksums don't belong to either state
+    if(hash_cache != nullptr && HashCache::FileKey(file_path) == cache_key)
+        hash_cache->Store(cache_key, HashCache::Entry{rom.crc, rom.md5, rom.sha1, data_track, o.verify, errors, edc_mode});
+
+    return FileEntry{rom, data_track, errors, edc_mode, sector_map};
 }
 
 
@@ -516,7 +585,7 @@ void update_info_from_dat(SubmissionInfo &info, const DAT::Game &g)
 }
 
 
-void submission(const Options &o, const filesystem::path &p, void *data)
+void submission(const Options &o, const filesystem::path &p, ostream &os, void *data)
 {
     try
     {
@@ -532,7 +601,7 @@ void submission(const Options &o, const filesystem::path &p, void *data)
             if(str_lowercase(filesystem::path(f).extension().generic_string()) != extension)
                 return;
 
-        cout << p.generic_string() << ": " << endl;
+        os << p.generic_string() << ": " << endl;
 
         // create basename without using filesystem routines as they mess up dots in path
         string basename = p.generic_string();
@@ -543,28 +612,74 @@ void submission(const Options &o, const filesystem::path &p, void *data)
         if(filesystem::exists(submission_file) && !o.overwrite)
         {
             if(o.verbose)
-                cout << "\tsubmission file already generated, skipping" << endl << endl;
+                os << "\tsubmission file already generated, skipping" << endl << endl;
 
             return;
         }
 
+        auto *context = reinterpret_cast<SubmissionContext *>(data);
+
         SubmissionInfo info;
 
         filesystem::path data_track_path;
+        shared_ptr<SectorMap> data_track_map;
+
+        os << "\tchecksums calculation... " << flush;
+        vector<FileEntry> file_entries(cue_files.size());
+        {
+            // tracks are hashed concurrently, results are stored by CUE index,
+            // if discs are already processed in parallel, tracks of one disc are not
+            uint32_t track_jobs = o.track_jobs;
+            if(!track_jobs)
+                track_jobs = o.jobs == 1 ? max(thread::hardware_concurrency(), 1u) : 1;
+            track_jobs = min(track_jobs, (uint32_t)cue_files.size());
+
+            // verification gets all cores only if nothing above it runs in parallel
+            uint32_t verify_threads = o.verify_threads;
+            if(!verify_threads)
+                verify_threads = o.jobs != 1 || track_jobs > 1 ? 1 : max(thread::hardware_concurrency(), 1u);
+
+            unique_ptr<ThreadPool> pool;
+            if(track_jobs > 1)
+                pool = make_unique<ThreadPool>(track_jobs);
+
+            uint32_t index = 0;
+            for(auto const &f : cue_files)
+            {
+                auto &file_entry = file_entries[index++];
+                auto job = [&]()
+                           {
+                               bool data_track = ImageBrowser::IsDataTrack(p.parent_path() / f);
+                               file_entry = create_file_entry(p.parent_path(), f, data_track, o, verify_threads, context->hash_cache);
+                           };
+
+                if(pool)
+                    pool->Submit(job);
+                else
+                    job();
+            }
+            if(pool)
+                pool->Wait();
+        }
 
-        cout << "\tchecksums calculation... " << flush;
         list<DAT::Game::Rom> roms;
-        for(auto const &f : cue_files)
+        for(uint32_t i = 0; i < file_entries.size(); ++i)
         {
-            bool data_track = ImageBrowser::IsDataTrack(p.parent_path() / f);
-            if(data_track)
+            auto const &fe = file_entries[i];
+            if(fe.data_track)
             {
                 if(data_track_path.empty())
-                    data_track_path = p.parent_path() / f;
+                {
+                    data_track_path = p.parent_path() / fe.rom.name;
+                    data_track_map = fe.sector_map;
+                }
+
+                info.error_count = to_string(fe.errors);
+                info.edc = fe.edc ? "Yes" : "No";
             }
-            roms.emplace_back(create_file_entry(p.parent_path(), f, info, data_track));
+            roms.push_back(fe.rom);
         }
-        cout << "done" << endl;
+        os << "done" << endl;
 
         DiscSystem disc_system = data_track_path.empty() ? DiscSystem::AUDIO : DiscSystem::DATA;
 
@@ -586,7 +701,7 @@ void submission(const Options &o, const filesystem::path &p, void *data)
         {
             // data track filesystem routines
             filesystem::path data_track(data_track_path);
-            ImageBrowser browser(data_track);
+            ImageBrowser browser(data_track, data_track_map, o.fs_jobs, o.index_cache_path, o.mmap);
 
             // PVD
             auto pvd = browser.GetPVD();
@@ -594,7 +709,7 @@ void submission(const Options &o, const filesystem::path &p, void *data)
 
             // exe path/date and disc system detection
             string exe_path = psx::extract_exe_path(browser);
-            auto exe_file = browser.RootDirectory()->SubEntry(exe_path);
+            auto exe_file = browser.RootDirectory().SubEntry(exe_path);
             disc_system = (exe_file ? DiscSystem::PSX : DiscSystem::PC);
 
             switch(disc_system)
@@ -609,9 +724,9 @@ void submission(const Options &o, const filesystem::path &p, void *data)
                 info.copy_protection.clear();
 
                 {
-                    time_t t = exe_file->DateTime();
+                    auto tm = local_time(exe_file->DateTime());
                     char buffer[32];
-                    strftime(buffer, 32, "%Y-%m-%d", localtime(&t));
+                    strftime(buffer, 32, "%Y-%m-%d", &tm);
                     info.exe_date = buffer;
                 }
 
@@ -629,7 +744,7 @@ void submission(const Options &o, const filesystem::path &p, void *data)
                     info.region = region;
 
                 // antimod
-                cout << "\tsearching for anti modchip string... " << flush;
+                os << "\tsearching for anti modchip string... " << flush;
                 {
                     auto entries = psx::detect_anti_modchip_string(browser);
                     stringstream ss;
@@ -641,7 +756,7 @@ void submission(const Options &o, const filesystem::path &p, void *data)
 
                     info.antimod = am_log;
                 }
-                cout << "done" << endl;
+                os << "done" << endl;
 
                 // libcrypt
                 if(region == "Europe")
@@ -749,10 +864,9 @@ void submission(const Options &o, const filesystem::path &p, void *data)
         }
 
         // fill missing information from DAT file
-        auto *dat = reinterpret_cast<DAT *>(data);
-        if(dat != nullptr)
+        if(context->dat != nullptr)
         {
-            DAT::Game *game = dat->FindGame(roms);
+            DAT::Game *game = context->dat->FindGame(roms);
 
             // game not found (new disc submission or outdated dat file)
             if(game == nullptr)
@@ -807,16 +921,16 @@ void submission(const Options &o, const filesystem::path &p, void *data)
             info >> ofs;
         }
 
-        cout << endl;
+        os << endl;
     }
     catch(const exception &e)
     {
-        cout << "{" << e.what() << "}" << endl << endl;
+        os << "{" << e.what() << "}" << endl << endl;
     }
 }
 
 
-void submission_test(const Options &o, const std::filesystem::path &f, void *data)
+void submission_test(const Options &o, const std::filesystem::path &f, ostream &os, void *data)
 {
     static set<string> combinations;
 
@@ -834,12 +948,12 @@ void submission_test(const Options &o, const std::filesystem::path &f, void *dat
         {
             combinations.insert(o);
 
-            cout << "combinations: " << endl;
+            os << "combinations: " << endl;
             for(auto const &c : combinations)
             {
-                cout << c << endl;
+                os << c << endl;
             }
-            cout << endl;
+            os << endl;
         }
     }
 }
@@ -3,6 +3,7 @@
 
 
 #include <filesystem>
+#include <ostream>
 #include "options.hh"
 
 
@@ -10,6 +11,17 @@
 namespace redump_info
 {
 
+class DAT;
+class HashCache;
+
+// submission callback data, both members are optional, shared between concurrently processed discs
+struct SubmissionContext
+{
+    const DAT *dat;
+    HashCache *hash_cache;
+};
+
+
 enum class DiscSystem
 {
     AUDIO,
@@ -19,7 +31,7 @@ enum class DiscSystem
 };
 
 
-void submission(const Options &o, const std::filesystem::path &f, void *data);
-void submission_test(const Options &o, const std::filesystem::path &f, void *data);
+void submission(const Options &o, const std::filesystem::path &f, std::ostream &os, void *data);
+void submission_test(const Options &o, const std::filesystem::path &f, std::ostream &os, void *data);
 
 }
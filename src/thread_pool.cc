@@ -0,0 +1,145 @@
+#include <algorithm>
+#include "thread_pool.hh"
+
+
+
+namespace redump_info
+{
+
+// identifies pool worker thread so nested submissions stay local
+static thread_local const ThreadPool *tl_pool = nullptr;
+static thread_local uint32_t tl_worker = 0;
+
+
+ThreadPool::ThreadPool(uint32_t threads_count)
+    : _nextWorker(0)
+    , _tasksQueued(0)
+    , _tasksPending(0)
+    , _stop(false)
+{
+    if(!threads_count)
+        threads_count = std::max(std::thread::hardware_concurrency(), 1u);
+
+    _workers.reserve(threads_count);
+    for(uint32_t i = 0; i < threads_count; ++i)
+        _workers.push_back(std::make_unique<Worker>());
+
+    _threads.reserve(threads_count);
+    for(uint32_t i = 0; i < threads_count; ++i)
+        _threads.emplace_back(&ThreadPool::WorkerLoop, this, i);
+}
+
+
+ThreadPool::~ThreadPool()
+{
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _stop = true;
+    }
+    _taskAvailable.notify_all();
+
+    for(auto &t : _threads)
+        t.join();
+}
+
+
+uint32_t ThreadPool::Size() const
+{
+    return (uint32_t)_threads.size();
+}
+
+
+void ThreadPool::Submit(const std::function<void()> &task)
+{
+    uint32_t index = tl_pool == this ? tl_worker : _nextWorker++ % Size();
+
+    // queued counter is updated under the pool mutex so sleeping worker can't miss the task
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        ++_tasksPending;
+        ++_tasksQueued;
+    }
+
+    {
+        auto &w = *_workers[index];
+        std::lock_guard<std::mutex> lock(w.mutex);
+        w.tasks.push_back(task);
+    }
+
+    _taskAvailable.notify_one();
+}
+
+
+void ThreadPool::Wait()
+{
+    std::unique_lock<std::mutex> lock(_mutex);
+    _tasksDone.wait(lock, [this]{ return !_tasksPending; });
+
+    if(_exception)
+    {
+        auto exception = _exception;
+        _exception = nullptr;
+        std::rethrow_exception(exception);
+    }
+}
+
+
+bool ThreadPool::TakeTask(std::function<void()> &task, uint32_t index)
+{
+    // own deque first, then steal from others
+    for(uint32_t i = 0; i < Size(); ++i)
+    {
+        auto &w = *_workers[(index + i) % Size()];
+        std::lock_guard<std::mutex> lock(w.mutex);
+        if(!w.tasks.empty())
+        {
+            task = std::move(w.tasks.front());
+            w.tasks.pop_front();
+            --_tasksQueued;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+
+void ThreadPool::WorkerLoop(uint32_t index)
+{
+    tl_pool = this;
+    tl_worker = index;
+
+    for(;;)
+    {
+        std::function<void()> task;
+        while(!TakeTask(task, index))
+        {
+            std::unique_lock<std::mutex> lock(_mutex);
+            _taskAvailable.wait(lock, [this]{ return _stop || _tasksQueued; });
+            if(_stop && !_tasksQueued)
+                return;
+        }
+
+        std::exception_ptr exception;
+        try
+        {
+            task();
+        }
+        catch(...)
+        {
+            exception = std::current_exception();
+        }
+
+        bool done;
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            if(exception && !_exception)
+                _exception = exception;
+            done = !--_tasksPending;
+        }
+        if(done)
+            _tasksDone.notify_all();
+    }
+}
+
+}
@@ -0,0 +1,62 @@
+#pragma once
+
+
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+
+
+namespace redump_info
+{
+
+// work stealing pool, every worker has it's own task deque, tasks submitted from outside
+// are distributed round robin, tasks submitted by a worker go to it's own deque,
+// worker runs tasks from it's own deque and steals from others when idle,
+// tasks are always taken oldest first so submission order is kept as priority
+class ThreadPool
+{
+public:
+    // 0 means one thread per hardware thread
+    ThreadPool(uint32_t threads_count);
+    ~ThreadPool();
+
+    uint32_t Size() const;
+
+    void Submit(const std::function<void()> &task);
+
+    // blocks until every submitted task is finished, rethrows first task exception
+    void Wait();
+
+private:
+    struct Worker
+    {
+        std::mutex mutex;
+        std::deque<std::function<void()>> tasks;
+    };
+
+    std::vector<std::unique_ptr<Worker>> _workers;
+    std::vector<std::thread> _threads;
+    std::atomic<uint32_t> _nextWorker;
+    std::atomic<uint32_t> _tasksQueued;
+
+    std::mutex _mutex;
+    std::condition_variable _taskAvailable;
+    std::condition_variable _tasksDone;
+    uint32_t _tasksPending;
+    bool _stop;
+    std::exception_ptr _exception;
+
+    bool TakeTask(std::function<void()> &task, uint32_t index);
+    void WorkerLoop(uint32_t index);
+};
+
+}